@@ -0,0 +1,136 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+// Compares loading bitfiles with bulk reads and vectorized bit reversal against
+// the previous byte-wise fread and table lookup. Takes an optional bitfile path,
+// otherwise a synthetic bitfile of the given size in MB (default 8) is written.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "devices/xc3sprog/bitfile.h"
+#include "devices/xc3sprog/bitrev.h"
+#include "processing/ByteOrder.h"
+
+static double seconds_since(std::chrono::steady_clock::time_point t_start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+}
+
+static std::string writeSyntheticBitfile(size_t n_bytes) {
+	char fname[] = "/tmp/bitfile-benchmark-XXXXXX";
+	int fd = mkstemp(fname);
+	if (fd < 0) throw std::runtime_error("Could not create temporary file");
+	FILE* fh = fdopen(fd, "wb");
+
+	// header followed by the data field 'e' with 32bit big-endian length
+	const uint8_t header[13] = {0x00, 0x09, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0, 0x00, 0x00, 0x01};
+	const uint8_t field[5] = {'e', uint8_t(n_bytes >> 24), uint8_t(n_bytes >> 16), uint8_t(n_bytes >> 8), uint8_t(n_bytes)};
+	std::vector<uint8_t> data(n_bytes);
+	for (auto& b: data) b = rand();
+	fwrite(header, 1, sizeof(header), fh);
+	fwrite(field, 1, sizeof(field), fh);
+	fwrite(data.data(), 1, data.size(), fh);
+	fclose(fh);
+	return fname;
+}
+
+// payload loop of BitFile::processData before bulk reads
+static std::vector<uint8_t> readBytewise(const std::string& fname) {
+	FILE* fh = fopen(fname.c_str(), "rb");
+	if (!fh) throw std::runtime_error("Could not open bitfile");
+	uint8_t t[4];
+	fseek(fh, 13, SEEK_SET);
+	while (fread(t, 1, 1, fh) == 1 && t[0] != 'e') {
+		uint8_t len[2];
+		if (fread(len, 1, 2, fh) != 2) break;
+		fseek(fh, (len[0] << 8) | len[1], SEEK_CUR);
+	}
+	if (fread(t, 1, 4, fh) != 4) throw std::runtime_error("Unexpected end of file");
+	size_t length = (t[0] << 24) + (t[1] << 16) + (t[2] << 8) + t[3];
+	std::vector<uint8_t> buffer(length);
+	for (size_t i = 0; i < length && !feof(fh); i++) {
+		uint8_t b;
+		if (fread(&b, 1, 1, fh) != 1) break;
+		buffer[i] = bitRevTable[b];
+	}
+	fclose(fh);
+	return buffer;
+}
+
+static std::vector<uint8_t> readBitFile(const std::string& fname) {
+	BitFile bitfile;
+	FILE* fh = fopen(fname.c_str(), "rb");
+	if (!fh) throw std::runtime_error("Could not open bitfile");
+	int r = bitfile.readFile(fh, STYLE_BIT);
+	fclose(fh);
+	if (r != 0) throw std::runtime_error("Error processing bitfile");
+	return std::vector<uint8_t>(bitfile.getData(), bitfile.getData() + bitfile.getLengthBytes());
+}
+
+int main(int argc, char** argv) {
+	const int n_runs = 10;
+	std::string fname;
+	bool synthetic = true;
+	size_t n_mb = 8;
+	if (argc > 1 && access(argv[1], R_OK) == 0) {
+		fname = argv[1];
+		synthetic = false;
+	} else {
+		if (argc > 1) n_mb = std::strtoul(argv[1], nullptr, 10);
+		fname = writeSyntheticBitfile(n_mb * 1024 * 1024);
+	}
+
+	try {
+		// file loading, the first run warms up the page cache
+		std::vector<uint8_t> ref = readBytewise(fname);
+		std::vector<uint8_t> res = readBitFile(fname);
+		if (ref != res) throw std::runtime_error("Results differ");
+		double mb = ref.size() / (1024.0 * 1024.0);
+		std::cout << "Payload: " << mb << " MB" << std::endl;
+
+		auto t_start = std::chrono::steady_clock::now();
+		for (int i = 0; i < n_runs; ++i) readBytewise(fname);
+		double t_bytewise = seconds_since(t_start) / n_runs;
+
+		t_start = std::chrono::steady_clock::now();
+		for (int i = 0; i < n_runs; ++i) readBitFile(fname);
+		double t_bulk = seconds_since(t_start) / n_runs;
+
+		std::cout << "Load byte-wise:  " << t_bytewise * 1e3 << " ms, " << mb / t_bytewise << " MB/s" << std::endl;
+		std::cout << "Load bulk:       " << t_bulk * 1e3 << " ms, " << mb / t_bulk << " MB/s" << std::endl;
+
+		// bit reversal of the payload in memory
+		std::vector<uint8_t> out(ref.size());
+		t_start = std::chrono::steady_clock::now();
+		for (int i = 0; i < n_runs; ++i) {
+			for (size_t j = 0; j < ref.size(); ++j) out[j] = bitRevTable[ref[j]];
+		}
+		double t_table = seconds_since(t_start) / n_runs;
+		uint8_t check = out[out.size() / 2];
+
+		t_start = std::chrono::steady_clock::now();
+		for (int i = 0; i < n_runs; ++i) reverseBits8(ref.data(), out.data(), ref.size());
+		double t_simd = seconds_since(t_start) / n_runs;
+		if (out[out.size() / 2] != check) throw std::runtime_error("Results differ");
+
+		std::cout << "Reverse table:   " << t_table * 1e3 << " ms, " << mb / t_table << " MB/s" << std::endl;
+		std::cout << "Reverse vector:  " << t_simd * 1e3 << " ms, " << mb / t_simd << " MB/s" << std::endl;
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		if (synthetic) unlink(fname.c_str());
+		return 1;
+	}
+	if (synthetic) unlink(fname.c_str());
+	return 0;
+}
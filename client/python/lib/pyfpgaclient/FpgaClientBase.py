@@ -6,11 +6,20 @@
 # The full license is in the file COPYING.txt, distributed with this software.
 #-----------------------------------------------------------------------------
 
+import hashlib
 import msgpack
 import numpy as np
+import os
 import socket
+import struct
 import warnings
+import weakref
+import mmap
 from six import text_type, PY3
+try:
+    import lz4.block
+except ImportError:
+    lz4 = None
 
 _DEFAULT_DEVICE_MIXIN_MAP = {}
 
@@ -39,12 +48,47 @@ class FpgaDevice(object):
     def write_reg(self, addr, port, val):
         return self._client.write_reg(self._serial, addr, port, val)
 
+    def reg_history(self, addr, port, t_from=0, t_to=None, max_points=0):
+        return self._client.reg_history(self._serial, addr, port, t_from, t_to, max_points)
+
+    def seq_run(self, name, max_steps=10000000):
+        return self._client.seq_run(self._serial, name, max_steps)
+
     def write_reg_n(self, addr, port, data):
         return self._client.write_reg_n(self._serial, addr, port, data)
 
+    def write_reg_n_cached(self, addr, port, data):
+        return self._client.write_reg_n_cached(self._serial, addr, port, data)
+
+    def write_reg_n_delta(self, addr, port, data):
+        return self._client.write_reg_n_delta(self._serial, addr, port, data)
+
+    def write_reg_n_runs(self, addr, port, runs):
+        return self._client.write_reg_n_runs(self._serial, addr, port, runs)
+
+    def write_reg_n_chunked(self, addr, port, data, chunk_words=256*1024):
+        return self._client.write_reg_n_chunked(self._serial, addr, port, data, chunk_words)
+
     def read_reg_n(self, addr, port, n_words):
         return self._client.read_reg_n(self._serial, addr, port, n_words)
 
+    def read_reg_n_stream(self, addr, port, n_words):
+        return self._client.read_reg_n_stream(self._serial, addr, port, n_words)
+
+    def read_reg_n_reduce(self, addr, port, n_words, mode, factor):
+        return self._client.read_reg_n_reduce(self._serial, addr, port, n_words, mode, factor)
+
+    def triggered_read(self, status_addr, status_port, mask, value, data_addr, data_port, n_words,
+                       timeout_ms=1000, poll_us=None, rearm=None):
+        return self._client.triggered_read(self._serial, status_addr, status_port, mask, value,
+                                           data_addr, data_port, n_words, timeout_ms, poll_us, rearm)
+
+    def read_reg_n_histogram(self, addr, port, n_words, lo, bin_width, n_bins):
+        return self._client.read_reg_n_histogram(self._serial, addr, port, n_words, lo, bin_width, n_bins)
+
+    def read_reg_n_events(self, addr, port, n_words, threshold, edge="rising", max_events=1024):
+        return self._client.read_reg_n_events(self._serial, addr, port, n_words, threshold, edge, max_events)
+
     def _write_raw(self, data):
         return self._client.write_raw(self._serial, data)
 
@@ -58,6 +102,12 @@ class FpgaClientBase(object):
     RPC_RCODE_ADDED = 1
     RPC_RCODE_REMOVED = 2
     RPC_RCODE_REG_CHANGED = 3
+    RPC_RCODE_CHUNK = 4
+    RPC_RCODE_ACQ_BLOCK = 5
+    RPC_RCODE_PROGRAMMING = 6
+
+    RPC_EXT_SHM = 1
+    RPC_EXT_LZ4 = 2
 
     DEVICE_MIXIN_MAP = _DEFAULT_DEVICE_MIXIN_MAP
     DEVICE_BASE_CLASS = FpgaDevice
@@ -66,6 +116,11 @@ class FpgaClientBase(object):
         self.__unpacker = msgpack.Unpacker()
         self._answers = []
         self._devices = {}
+        self._stream_data = bytearray()
+        self._shm = None
+        self._shm_released = []
+        self._compression_min_bytes = None
+        self._byteorder = ">"
 
     @classmethod
     def registerDeviceMixin(cls, serial_prefix, DeviceMixin):
@@ -87,6 +142,10 @@ class FpgaClientBase(object):
         # implement method for handling requests for more data
         raise NotImplementedError()
 
+    def _receive_fd(self):
+        # implement method for returning a file descriptor received from the server
+        raise NotImplementedError()
+
     def _device_added(self, serial, device):
         # implement method for handling added devices
         pass
@@ -95,6 +154,14 @@ class FpgaClientBase(object):
         # implement method for handling removed devices
         pass
 
+    def _acquisition_block(self, name, seq, timestamp_us, data):
+        # implement method for handling blocks of subscribed acquisitions
+        pass
+
+    def _device_programming(self, serial, phase, bytes_done, bytes_total, elapsed_ms):
+        # implement method for handling programming progress of devices
+        pass
+
     def _parse_data(self, data):
         # use method for handling incoming data
         self.__unpacker.feed(data)
@@ -117,6 +184,16 @@ class FpgaClientBase(object):
                 serial, addr, port, value = packet[1:5]
                 serial = serial.decode() if PY3 else serial
                 self.__handle_reg_changed(serial, addr, port, value)
+            elif rcode == FpgaClientBase.RPC_RCODE_CHUNK:
+                self._stream_data.extend(packet[1])
+            elif rcode == FpgaClientBase.RPC_RCODE_ACQ_BLOCK:
+                name = packet[1].decode() if PY3 else packet[1]
+                self._acquisition_block(name, *self.__acq_block(packet[2]))
+            elif rcode == FpgaClientBase.RPC_RCODE_PROGRAMMING:
+                serial, phase, bytes_done, bytes_total, elapsed_ms = packet[1:6]
+                serial = serial.decode() if PY3 else serial
+                phase = phase.decode() if PY3 else phase
+                self._device_programming(serial, phase, bytes_done, bytes_total, elapsed_ms)
             else:
                 warnings.warn("unknown packet type (rcode=%d)" % rcode)
 
@@ -130,9 +207,28 @@ class FpgaClientBase(object):
             return packet
 
     def __send_object(self, obj):
-        data = msgpack.packb(obj, use_bin_type=True)
+        # notify server about shared memory regions no longer in use
+        data = b"".join(msgpack.packb(["shm_release", offset], use_bin_type=True)
+                        for offset in self._shm_released)
+        del self._shm_released[:]
+        data += msgpack.packb(obj, use_bin_type=True)
         self._write_data(data)
 
+    def __bulk_data(self, data, dtype, count):
+        if not isinstance(data, msgpack.ExtType):
+            return np.frombuffer(data, dtype=dtype, count=count)
+        if data.code == FpgaClientBase.RPC_EXT_LZ4:
+            n_bytes = struct.unpack(">I", data.data[:4])[0]
+            data = lz4.block.decompress(data.data[4:], uncompressed_size=n_bytes)
+            return np.frombuffer(data, dtype=dtype, count=count)
+        if data.code != FpgaClientBase.RPC_EXT_SHM or self._shm is None:
+            raise ValueError("unexpected bulk data reply")
+        # data is located in shared memory, return view and release region when unused
+        offset, n_bytes = struct.unpack(">QQ", data.data)
+        array = np.frombuffer(self._shm, dtype=dtype, count=count, offset=offset)
+        weakref.finalize(array, self._shm_released.append, offset)
+        return array
+
     def __handle_added(self, serial):
         if serial in self._devices:
             return
@@ -176,6 +272,53 @@ class FpgaClientBase(object):
             if serial not in device_list:
                 self.__handle_removed(serial)
 
+    def __bulk_payload(self, data):
+        # compress payload if negotiated with the server
+        if self._compression_min_bytes is None or len(data) < self._compression_min_bytes:
+            return data
+        compressed = lz4.block.compress(data, store_size=False)
+        return msgpack.ExtType(FpgaClientBase.RPC_EXT_LZ4, struct.pack(">I", len(data)) + compressed)
+
+    def set_compression(self, min_bytes=16*1024):
+        """
+        Enable LZ4 compression of bulk data transfers larger than min_bytes,
+        or disable compression if min_bytes is None.
+        """
+        if min_bytes is None:
+            self.__send_object(["set_compression", "none"])
+        else:
+            if lz4 is None:
+                raise RuntimeError("lz4 module not available")
+            self.__send_object(["set_compression", "lz4", min_bytes])
+        self._wait_for_answer()
+        self._compression_min_bytes = min_bytes
+
+    def set_byteorder(self, order="little"):
+        """
+        Set the byte order of register data exchanged with the server to
+        "big" (default) or "little". Little-endian data can be used on x86
+        hosts without conversion, the server swaps the bytes.
+        """
+        self.__send_object(["set_byteorder", order])
+        self._wait_for_answer()
+        self._byteorder = "<" if order == "little" else ">"
+
+    def attach_shm(self, n_bytes):
+        """
+        Attach a shared memory ring for receiving bulk data. Only available
+        for connections through a local socket. Bulk data replies are returned
+        as views into the shared memory and released when garbage collected.
+
+        :n_bytes: size of the shared memory ring
+        """
+        self.__send_object(["shm_attach", n_bytes])
+        n_bytes = self._wait_for_answer()[1]
+        fd = self._receive_fd()
+        try:
+            self._shm = mmap.mmap(fd, n_bytes, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+
     def get_device_list(self):
         # refresh device list and get internal device list in sync
         self.__send_object(["devicelist"])
@@ -199,27 +342,270 @@ class FpgaClientBase(object):
         self._wait_for_answer()
         return
 
+    def reg_history(self, serial, addr, port, t_from=0, t_to=None, max_points=0):
+        """
+        Get the recorded changes of a tracked register between t_from and t_to
+        (seconds since epoch, None for now), including the value held at t_from. If max_points
+        is given, the history is reduced to the minimum and maximum values within
+        max_points/2 time buckets. Returns arrays of times and values.
+        """
+        t_from_ms = int(t_from * 1000)
+        t_to_ms = 2**64 - 1 if t_to is None else int(t_to * 1000)
+        self.__send_object(["reghistory", serial, addr, port, t_from_ms, t_to_ms, max_points])
+        times, values = self._wait_for_answer()[1]
+        return np.asarray(times, dtype=np.float64) / 1000, np.asarray(values, dtype=np.uint16)
+
     def write_reg_n(self, serial, addr, port, data):
-        data_raw_be = bytes(np.asarray(data, dtype=">u2").data)
-        self.__send_object(["writeregn", serial, addr, port, data_raw_be])
+        data_raw = bytes(np.asarray(data, dtype=self._byteorder + "u2").data)
+        self.__send_object(["writeregn", serial, addr, port, self.__bulk_payload(data_raw)])
         self._wait_for_answer()
         return
 
+    def write_reg_n_cached(self, serial, addr, port, data):
+        """
+        Write data to register, the payload is only sent if the server does not
+        have it cached from a previous upload. Returns True if it was cached.
+        """
+        data_raw_be = bytes(np.asarray(data, dtype=">u2").data)
+        digest = hashlib.sha256(data_raw_be).digest()
+        self.__send_object(["writeregn_cached", serial, addr, port, digest])
+        if self._wait_for_answer()[1]:
+            return True
+        self.__send_object(["writeregn_cached", serial, addr, port, digest, data_raw_be])
+        self._wait_for_answer()
+        return False
+
+    def write_reg_n_delta(self, serial, addr, port, data):
+        """
+        Write the full contents of a shadowed port, the server only sends words
+        that changed since the last write. Returns the number of words sent.
+        """
+        data_raw = bytes(np.asarray(data, dtype=self._byteorder + "u2").data)
+        self.__send_object(["writeregn_delta", serial, addr, port, data_raw])
+        return self._wait_for_answer()[1]
+
+    def write_reg_n_runs(self, serial, addr, port, runs):
+        """
+        Write runs of words to a shadowed port given as [(offset, data), ...].
+        Returns the number of words sent.
+        """
+        runs_raw = [[offset, bytes(np.asarray(data, dtype=self._byteorder + "u2").data)]
+                    for offset, data in runs]
+        self.__send_object(["writeregn_delta", serial, addr, port, runs_raw])
+        return self._wait_for_answer()[1]
+
+    def write_reg_n_chunked(self, serial, addr, port, data, chunk_words=256*1024):
+        data = np.ascontiguousarray(data, dtype=self._byteorder + "u2")
+        self.__send_object(["writeregn_begin", serial, addr, port])
+        upload_id = self._wait_for_answer()[1]
+        return self.__upload_chunks(upload_id, data, 2 * chunk_words)
+
+    def __upload_chunks(self, upload_id, data, chunk_bytes):
+        # chunks are not answered, only the final upload_end is,
+        # only one chunk at a time is copied from the array
+        view = memoryview(data.reshape(-1).view(np.uint8))
+        for i in range(0, len(view), chunk_bytes):
+            self.__send_object(["upload_chunk", upload_id, view[i:i + chunk_bytes].tobytes()])
+        self.__send_object(["upload_end", upload_id])
+        return self._wait_for_answer()[1]
+
     def read_reg_n(self, serial, addr, port, n_words):
         self.__send_object(["readregn", serial, addr, port, n_words])
-        data_raw_be = self._wait_for_answer()[1]
-        return np.frombuffer(data_raw_be, dtype=">u2", count=n_words)
+        data_raw = self._wait_for_answer()[1]
+        return self.__bulk_data(data_raw, dtype=self._byteorder + "u2", count=n_words)
+
+    def read_reg_n_reduce(self, serial, addr, port, n_words, mode, factor):
+        """
+        Read n_words from register and reduce the data on the server in bins
+        of factor words. Mode "minmax" returns a tuple of min and max arrays,
+        "mean" returns the rounded mean values and "decimate" every factor-th word.
+        """
+        self.__send_object(["readregn_reduce", serial, addr, port, n_words, mode, factor])
+        result = self._wait_for_answer()[1]
+        if mode == "minmax":
+            return tuple(np.frombuffer(r, dtype=self._byteorder + "u2") for r in result)
+        return np.frombuffer(result, dtype=self._byteorder + "u2")
+
+    def read_reg_n_histogram(self, serial, addr, port, n_words, lo, bin_width, n_bins):
+        """
+        Read n_words from register and histogram the values on the server. Bin i
+        counts values in [lo + i*bin_width, lo + (i+1)*bin_width). Returns the
+        counts together with the number of values below and above all bins.
+        """
+        self.__send_object(["readregn_histogram", serial, addr, port, n_words, lo, bin_width, n_bins])
+        counts, underflow, overflow = self._wait_for_answer()[1]
+        return np.frombuffer(counts, dtype=self._byteorder + "u4"), underflow, overflow
+
+    def read_reg_n_events(self, serial, addr, port, n_words, threshold, edge="rising", max_events=1024):
+        """
+        Read n_words from register and extract threshold crossings on the server.
+        Edge is "rising", "falling" or "both". Returns the total number of
+        crossings and the indices and values of the first max_events crossings.
+        """
+        self.__send_object(["readregn_events", serial, addr, port, n_words, threshold, edge, max_events])
+        n_events, indices, values = self._wait_for_answer()[1]
+        return n_events, np.frombuffer(indices, dtype=self._byteorder + "u4"), np.frombuffer(values, dtype=self._byteorder + "u2")
+
+    def triggered_read(self, serial, status_addr, status_port, mask, value, data_addr, data_port, n_words,
+                       timeout_ms=1000, poll_us=None, rearm=None):
+        """
+        Wait on the server until (status & mask) == value, then read n_words from
+        the data register and optionally re-arm by writing rearm = (addr, port, value).
+        Returns the data together with the server timestamps (us since epoch) of the
+        trigger and of the completed read. The server polls every poll_us (default
+        1000, at least 500) for at most 60 s.
+        """
+        self.__send_object(["triggered_read", serial, status_addr, status_port, mask, value,
+                            data_addr, data_port, n_words, timeout_ms, poll_us,
+                            list(rearm) if rearm is not None else None])
+        data_raw, t_trigger, t_read = self._wait_for_answer()[1]
+        return np.frombuffer(data_raw, dtype=self._byteorder + "u2"), t_trigger, t_read
+
+    def read_reg_n_stream(self, serial, addr, port, n_words):
+        self.__send_object(["readregn_stream", serial, addr, port, n_words])
+        return self.__wait_for_stream(self._byteorder + "u2", n_words)
+
+    def __wait_for_stream(self, dtype, count):
+        # collect data chunks received before the final answer, which describes
+        # a shared memory region instead if the data was streamed there
+        self._stream_data = bytearray()
+        try:
+            answer = self._wait_for_answer()[1]
+            if isinstance(answer, msgpack.ExtType):
+                return self.__bulk_data(answer, dtype, count)
+            return np.frombuffer(self._stream_data, dtype=dtype, count=count)
+        finally:
+            self._stream_data = bytearray()
 
     def write_raw(self, serial, data):
         data_raw = bytes(np.asarray(data, dtype=np.uint8).data)
-        self.__send_object(["writeraw", serial, data_raw])
+        self.__send_object(["writeraw", serial, self.__bulk_payload(data_raw)])
         self._wait_for_answer()
         return
 
+    def read_raw_stream(self, serial, n_bytes):
+        self.__send_object(["readraw_stream", serial, n_bytes])
+        return self.__wait_for_stream(np.uint8, n_bytes)
+
+    def write_raw_chunked(self, serial, data, chunk_bytes=512*1024):
+        data = np.ascontiguousarray(data, dtype=np.uint8)
+        self.__send_object(["writeraw_begin", serial])
+        upload_id = self._wait_for_answer()[1]
+        return self.__upload_chunks(upload_id, data, chunk_bytes)
+
     def read_raw(self, serial, n_bytes):
         self.__send_object(["readraw", serial, n_bytes])
         data_raw = self._wait_for_answer()[1]
-        return np.frombuffer(data_raw, dtype=np.uint8, count=n_bytes)
+        return self.__bulk_data(data_raw, dtype=np.uint8, count=n_bytes)
+
+    def server_time(self):
+        """
+        Returns the monotonic clock of the server in us.
+        """
+        self.__send_object(["server_time"])
+        return self._wait_for_answer()[1]
+
+    def schedule(self, writes, base_us=None):
+        """
+        Execute register writes at precise times on the server. writes is a list of
+        (serial, addr, port, value, offset_us), executed at base_us + offset_us of the
+        server clock (see server_time) or relative to now if base_us is None. Returns
+        (lateness_ns, duration_ns, error) per write after all writes were executed.
+        """
+        self.__send_object(["schedule", base_us, [list(w) for w in writes]])
+        return [tuple(r) for r in self._wait_for_answer()[1]]
+
+    def group_write(self, targets, addr, port, value):
+        """
+        Write a register on several devices in parallel. targets is a serial prefix
+        or a list of serials. Returns (serial, start_ns, done_ns, error) per device,
+        times relative to the common start time of all writes.
+        """
+        if not isinstance(targets, (str, text_type)):
+            targets = list(targets)
+        self.__send_object(["groupwrite", targets, addr, port, value])
+        return [tuple(r) for r in self._wait_for_answer()[1]]
+
+    def seq_upload(self, name, program):
+        """
+        Upload a sequencer program (bytes, see Sequencer.SequencerProgram) to the server.
+        """
+        self.__send_object(["seq_upload", name, bytes(program)])
+        return self._wait_for_answer()[1]
+
+    def seq_remove(self, name):
+        self.__send_object(["seq_remove", name])
+        self._wait_for_answer()
+
+    def seq_run(self, serial, name, max_steps=10000000):
+        """
+        Run an uploaded program on a device. Returns the emitted results and
+        the number of executed instructions. The server limits max_steps to
+        10^8 and the results to 4M words.
+        """
+        self.__send_object(["seq_run", name, serial, max_steps])
+        results, steps = self._wait_for_answer()[1]
+        return np.frombuffer(results, dtype=self._byteorder + "u2"), steps
+
+    def __acq_block(self, block):
+        # processed blocks carry (counts, underflow, overflow) or (n_events, indices, values)
+        seq, timestamp_us, data = block
+        if not isinstance(data, (list, tuple)):
+            return seq, timestamp_us, np.frombuffer(data, dtype=self._byteorder + "u2")
+        if isinstance(data[0], bytes):
+            counts, underflow, overflow = data
+            return seq, timestamp_us, (np.frombuffer(counts, dtype=self._byteorder + "u4"), underflow, overflow)
+        n_events, indices, values = data
+        return seq, timestamp_us, (n_events, np.frombuffer(indices, dtype=self._byteorder + "u4"),
+                                   np.frombuffer(values, dtype=self._byteorder + "u2"))
+
+    def acq_add(self, name, serial, addr, port, n_words, interval_ms, history=16, histogram=None, events=None):
+        """
+        Add a server-side acquisition reading n_words from a register every
+        interval_ms and keeping the last history blocks. With histogram=(lo, bin_width, n_bins)
+        or events=(threshold, edge, max_events) the server keeps and pushes only the result
+        of read_reg_n_histogram or read_reg_n_events for each block.
+        """
+        processing = None
+        if histogram is not None:
+            processing = ["histogram"] + list(histogram)
+        elif events is not None:
+            processing = ["events"] + list(events)
+        self.__send_object(["acq_add", name, serial, addr, port, n_words, interval_ms, history, processing])
+        self._wait_for_answer()
+
+    def acq_remove(self, name):
+        self.__send_object(["acq_remove", name])
+        self._wait_for_answer()
+
+    def acq_list(self):
+        """
+        Returns a list of (name, serial, addr, port, n_words, interval_ms, history, last_seq).
+        """
+        self.__send_object(["acq_list"])
+        return [tuple(job) for job in self._wait_for_answer()[1]]
+
+    def acq_latest(self, name):
+        """
+        Returns (seq, timestamp_us, data) of the latest block or None.
+        """
+        self.__send_object(["acq_latest", name])
+        block = self._wait_for_answer()[1]
+        return None if block is None else self.__acq_block(block)
+
+    def acq_range(self, name, seq_first, n_blocks):
+        """
+        Returns the blocks starting at sequence number seq_first still kept on the server.
+        """
+        self.__send_object(["acq_range", name, seq_first, n_blocks])
+        return [self.__acq_block(block) for block in self._wait_for_answer()[1]]
+
+    def acq_subscribe(self, name, enabled=True):
+        """
+        Subscribe to new blocks of an acquisition, which are passed to _acquisition_block.
+        """
+        self.__send_object(["acq_subscribe", name, enabled])
+        self._wait_for_answer()
 
 
 if __name__ == "__main__":
@@ -231,9 +617,16 @@ if __name__ == "__main__":
 
         def __init__(self, host, port=9002):
             FpgaClientBase.__init__(self)
-            self.__socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            if host.startswith("/"):
+                # host is the path of a local unix domain socket
+                self.__socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+                address = host
+            else:
+                self.__socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                address = (host, port)
             self.__socket.settimeout(SimpleFpgaClient.DEFAULT_TIMEOUT)
-            self.__socket.connect((host, port))
+            self.__socket.connect(address)
+            self.__fds = []
             # initialize device map by getting the device list after connect
             self.get_device_list()
 
@@ -247,11 +640,25 @@ if __name__ == "__main__":
                 bytes_sent += n
 
         def _require_data(self):
-            data = self.__socket.recv(8*1024)
+            data = self.__recv(8*1024)
             if not data:
                 raise RuntimeError("no response from server")
             self._parse_data(data)
 
+        def _receive_fd(self):
+            return self.__fds.pop(0)
+
+        def __recv(self, n_bytes):
+            if self.__socket.family != socket.AF_UNIX:
+                return self.__socket.recv(n_bytes)
+            # collect file descriptors passed by the server
+            fd_size = struct.calcsize("i")
+            data, ancdata, _, _ = self.__socket.recvmsg(n_bytes, socket.CMSG_SPACE(fd_size))
+            for level, type_, cdata in ancdata:
+                if level == socket.SOL_SOCKET and type_ == socket.SCM_RIGHTS:
+                    self.__fds.append(struct.unpack("i", cdata[:fd_size])[0])
+            return data
+
         def _device_added(self, serial, device):
             print("Device added: %s" % serial)
 
@@ -260,7 +667,7 @@ if __name__ == "__main__":
 
         def wait_for_events(self):
             try:
-                data = self.__socket.recv(8*1024)
+                data = self.__recv(8*1024)
                 self._parse_data(data)
             except socket.timeout:
                 pass
@@ -30,8 +30,10 @@ class QFpgaClient(QtCore.QObject, FpgaClientBase):
 
     deviceAdded = QtCore.pyqtSignal(text_type, object)
     deviceRemoved = QtCore.pyqtSignal(text_type)
+    deviceProgramming = QtCore.pyqtSignal(text_type, text_type, int, int, int)
     __deviceAddedQueue = QtCore.pyqtSignal(text_type, object)
     __deviceRemovedQueue = QtCore.pyqtSignal(text_type)
+    __deviceProgrammingQueue = QtCore.pyqtSignal(text_type, text_type, int, int, int)
 
     def __init__(self, host, port=9002):
         QtCore.QObject.__init__(self)
@@ -39,18 +41,25 @@ class QFpgaClient(QtCore.QObject, FpgaClientBase):
         # prevent event processing within synchronous calls
         self.__deviceAddedQueue.connect(self.deviceAdded, type=QtCore.Qt.QueuedConnection)
         self.__deviceRemovedQueue.connect(self.deviceRemoved, type=QtCore.Qt.QueuedConnection)
+        self.__deviceProgrammingQueue.connect(self.deviceProgramming, type=QtCore.Qt.QueuedConnection)
 
-        # setup tcp socket
+        # setup tcp socket, or local socket if host is a path
         self.__host = host
         self.__port = port
-        self.__socket = QtNetwork.QTcpSocket()
+        if host.startswith("/"):
+            self.__socket = QtNetwork.QLocalSocket()
+        else:
+            self.__socket = QtNetwork.QTcpSocket()
         self.__socket.readyRead.connect(self.__handle_ready_read)
         # TODO: handle other signals, like disconnected or error
 
     def connect(self):
         if not self.__socket.isOpen():
             # connect to server
-            self.__socket.connectToHost(self.__host, self.__port)
+            if isinstance(self.__socket, QtNetwork.QLocalSocket):
+                self.__socket.connectToServer(self.__host)
+            else:
+                self.__socket.connectToHost(self.__host, self.__port)
             if (not self.__socket.waitForConnected(QFpgaClient.DEFAULT_TIMEOUT * 1000)):
                 raise RuntimeError("Could not connect: %s" % self.__socket.errorString())
             # initialize device map by getting the device list
@@ -72,6 +81,9 @@ class QFpgaClient(QtCore.QObject, FpgaClientBase):
     def _device_removed(self, serial):
         self.__deviceRemovedQueue.emit(serial)
 
+    def _device_programming(self, serial, phase, bytes_done, bytes_total, elapsed_ms):
+        self.__deviceProgrammingQueue.emit(serial, phase, bytes_done, bytes_total, elapsed_ms)
+
     def __handle_ready_read(self):
         if self.__socket.bytesAvailable():
             data = self.__socket.read(self.__socket.bytesAvailable())
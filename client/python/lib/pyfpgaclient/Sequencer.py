@@ -0,0 +1,109 @@
+# -*- coding: utf-8 -*-
+#-----------------------------------------------------------------------------
+# Author: Peter Würtz, TU Kaiserslautern (2016)
+#
+# Distributed under the terms of the GNU General Public License Version 3.
+# The full license is in the file COPYING.txt, distributed with this software.
+#-----------------------------------------------------------------------------
+
+import struct
+
+OP_END = 0x00
+OP_WRITE = 0x01
+OP_WRITE_R = 0x02
+OP_READ = 0x03
+OP_WAIT = 0x04
+OP_SLEEP = 0x05
+OP_SET = 0x06
+OP_ADD = 0x07
+OP_AND = 0x08
+OP_BRANCH = 0x09
+OP_JUMP = 0x0a
+OP_LOOP = 0x0b
+OP_EMIT = 0x0c
+OP_READN = 0x0d
+
+CONDITIONS = {"eq": 0, "ne": 1, "lt": 2, "ge": 3, "all": 4, "any": 5}
+
+
+class SequencerProgram(object):
+    """
+    Assembler for server-side register sequences. Registers are numbered
+    0..7, jump targets are label names defined with label().
+
+    Example, read a status register until bit 0 is set, up to 100 times:
+
+        p = SequencerProgram()
+        p.set(0, 100)
+        p.label("poll")
+        p.read(1, 0, 1)
+        p.branch(1, "all", 0x0001, "done")
+        p.sleep_us(1000)
+        p.loop(0, "poll")
+        p.label("done")
+        p.emit(1)
+        p.end()
+        client.seq_upload("poll_ready", p.assemble())
+    """
+    def __init__(self):
+        self._code = bytearray()
+        self._labels = {}
+        self._fixups = []
+
+    def label(self, name):
+        self._labels[name] = len(self._code)
+
+    def __target(self, label):
+        self._fixups.append((len(self._code), label))
+        return 0
+
+    def end(self):
+        self._code += struct.pack(">B", OP_END)
+
+    def write(self, addr, port, value):
+        self._code += struct.pack(">BBBH", OP_WRITE, addr, port, value)
+
+    def write_r(self, addr, port, reg):
+        self._code += struct.pack(">BBBB", OP_WRITE_R, addr, port, reg)
+
+    def read(self, addr, port, reg):
+        self._code += struct.pack(">BBBB", OP_READ, addr, port, reg)
+
+    def wait(self, addr, port, mask, value, timeout_ms):
+        self._code += struct.pack(">BBBHHI", OP_WAIT, addr, port, mask, value, timeout_ms)
+
+    def sleep_us(self, us):
+        self._code += struct.pack(">BI", OP_SLEEP, us)
+
+    def set(self, reg, value):
+        self._code += struct.pack(">BBH", OP_SET, reg, value & 0xffff)
+
+    def add(self, reg, value):
+        self._code += struct.pack(">BBH", OP_ADD, reg, value & 0xffff)
+
+    def and_(self, reg, value):
+        self._code += struct.pack(">BBH", OP_AND, reg, value & 0xffff)
+
+    def branch(self, reg, cond, value, label):
+        self._code += struct.pack(">BBBH", OP_BRANCH, reg, CONDITIONS[cond], value)
+        self._code += struct.pack(">H", self.__target(label))
+
+    def jump(self, label):
+        self._code += struct.pack(">B", OP_JUMP)
+        self._code += struct.pack(">H", self.__target(label))
+
+    def loop(self, reg, label):
+        self._code += struct.pack(">BB", OP_LOOP, reg)
+        self._code += struct.pack(">H", self.__target(label))
+
+    def emit(self, reg):
+        self._code += struct.pack(">BB", OP_EMIT, reg)
+
+    def read_n(self, addr, port, n_words):
+        self._code += struct.pack(">BBBH", OP_READN, addr, port, n_words)
+
+    def assemble(self):
+        code = bytearray(self._code)
+        for offset, label in self._fixups:
+            struct.pack_into(">H", code, offset, self._labels[label])
+        return bytes(code)
@@ -6,6 +6,11 @@
 //-----------------------------------------------------------------------------
 
 #include "DeviceRequestHandler.h"
+#include "network/ClientConnection.h"
+#include "network/Compression.h"
+#include "processing/Reduction.h"
+#include "processing/Analysis.h"
+#include "processing/ByteOrder.h"
 
 template <int I=0, typename T>
 void msgpack_parse(std::vector<msgpack::object>& args, T& value)
@@ -20,28 +25,315 @@ void msgpack_parse(std::vector<msgpack::object>& args, U& head, T&... tail)
     msgpack_parse<I+1>(args, tail...);
 }
 
-DeviceRequestHandler::DeviceRequestHandler(DeviceManager& manager) :
+// Sends bulk data to a client as series of chunk messages followed by the final
+// reply. The next chunk is read once the client drained most of the previous ones.
+// If the client attached a shared memory ring with enough free space, the chunks are
+// read into one region of the ring instead and the final reply describes that region.
+class BulkStream : public std::enable_shared_from_this<BulkStream> {
+public:
+	BulkStream(ptrClientConnection_t client, size_t n_bytes, size_t n_chunk,
+			DeviceRequestHandler::stream_func_t read_func, ptrSharedMemoryRing_t ring) :
+		m_client(std::move(client)),
+		m_n_bytes(n_bytes),
+		m_n_chunk(n_chunk),
+		m_offset(0),
+		m_read_func(std::move(read_func)),
+		m_buffer(),
+		m_ring(std::move(ring)),
+		m_shm(nullptr),
+		m_shm_offset(0) {}
+
+	void start() {
+		// keep further requests from being answered before the stream is finished
+		m_client->suspend();
+		if (m_ring && m_n_bytes >= RPC_SHM_MIN_BYTES)
+			m_shm = m_ring->allocate(m_n_bytes, m_shm_offset);
+		next();
+	}
+
+private:
+	void next() {
+		if (!m_client->isOpen()) return;
+		auto buffer_out = std::make_shared<msgpack::sbuffer>();
+		msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+
+		// send final reply after the last chunk
+		if (m_offset == m_n_bytes) {
+			if (m_shm) {
+				RPC_REPLY_SHM(packer_out, m_shm_offset, m_n_bytes);
+			} else {
+				RPC_REPLY_VALUE(packer_out, m_n_bytes);
+			}
+			finish(buffer_out);
+			return;
+		}
+
+		// read next chunk and send it unless it went to shared memory
+		size_t n = std::min(m_n_chunk, m_n_bytes - m_offset);
+		uint8_t* data = m_shm ? m_shm + m_offset : nullptr;
+		if (!data) {
+			m_buffer.resize(n);
+			data = m_buffer.data();
+		}
+		try {
+			m_read_func(data, m_offset, n);
+		} catch (const std::exception& e) {
+			std::cerr << "Exception in RPC stream: " << e.what() << std::endl;
+			if (m_shm) m_ring->release(m_shm_offset);
+			RPC_REPLY_ERROR(packer_out, e.what());
+			finish(buffer_out);
+			return;
+		}
+		if (!m_shm) {
+			RPC_REPLY_CHUNK(packer_out, (char*) data, n);
+			m_client->send(buffer_out);
+		}
+		m_offset += n;
+
+		auto self(shared_from_this());
+		m_client->asyncWaitDrain(RPC_STREAM_DRAIN_BYTES, [this, self]() {
+			next();
+		});
+	}
+
+	void finish(std::shared_ptr<msgpack::sbuffer> buffer_out) {
+		m_client->send(buffer_out);
+		m_client->resume();
+	}
+
+	ptrClientConnection_t m_client;
+	size_t m_n_bytes;
+	size_t m_n_chunk;
+	size_t m_offset;
+	DeviceRequestHandler::stream_func_t m_read_func;
+	std::vector<uint8_t> m_buffer;
+	ptrSharedMemoryRing_t m_ring;
+	uint8_t* m_shm;
+	size_t m_shm_offset;
+};
+
+// Polls a status register until (status & mask) == value, then reads a block
+// of data and optionally re-arms the trigger by writing a control register.
+// Polling is scheduled on the event loop so other clients are served meanwhile.
+class TriggeredRead : public std::enable_shared_from_this<TriggeredRead> {
+public:
+	struct params_t {
+		uint8_t status_addr;
+		uint8_t status_port;
+		uint16_t mask;
+		uint16_t value;
+		uint8_t data_addr;
+		uint8_t data_port;
+		uint32_t n_words;
+		bool rearm;
+		uint8_t rearm_addr;
+		uint8_t rearm_port;
+		uint16_t rearm_value;
+		bool little_endian;
+	};
+
+	TriggeredRead(boost::asio::io_service& io_service, ptrClientConnection_t client,
+			ptrDevice_t device, const params_t& params,
+			std::chrono::milliseconds timeout, std::chrono::microseconds poll_interval) :
+		m_timer(io_service),
+		m_client(std::move(client)),
+		m_device(std::move(device)),
+		m_params(params),
+		m_deadline(std::chrono::steady_clock::now() + timeout),
+		m_poll_interval(poll_interval) {}
+
+	void start() {
+		m_client->suspend();
+		poll();
+	}
+
+private:
+	static uint64_t timestamp_us() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	void poll() {
+		if (!m_client->isOpen()) return;
+		auto buffer_out = std::make_shared<msgpack::sbuffer>();
+		msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+		try {
+			uint16_t status;
+			m_device->readReg(m_params.status_addr, m_params.status_port, &status);
+			if ((status & m_params.mask) == m_params.value) {
+				// read data right away, re-arm and reply with data and timestamps
+				uint64_t t_trigger = timestamp_us();
+				std::vector<uint16_t> data(m_params.n_words);
+				m_device->readRegN(m_params.data_addr, m_params.data_port, data.data(), data.size());
+				uint64_t t_read = timestamp_us();
+				if (m_params.rearm) {
+					m_device->writeReg(m_params.rearm_addr, m_params.rearm_port, m_params.rearm_value);
+				}
+				if (m_params.little_endian) swapBytes16(data.data(), data.data(), data.size());
+				size_t n_bytes = data.size() * sizeof(uint16_t);
+				packer_out.pack_array(2);
+				packer_out.pack_int8(RPC_RCODE_OK);
+				packer_out.pack_array(3);
+				packer_out.pack_bin(n_bytes);
+				packer_out.pack_bin_body((char*) data.data(), n_bytes);
+				packer_out << t_trigger << t_read;
+				finish(buffer_out);
+				return;
+			}
+		} catch (const std::exception& e) {
+			std::cerr << "Exception in RPC call: " << e.what() << std::endl;
+			RPC_REPLY_ERROR(packer_out, e.what());
+			finish(buffer_out);
+			return;
+		}
+
+		if (std::chrono::steady_clock::now() >= m_deadline) {
+			RPC_REPLY_ERROR(packer_out, "Trigger timeout");
+			finish(buffer_out);
+			return;
+		}
+
+		// poll again after the other pending handlers of the event loop ran
+		auto self(shared_from_this());
+		m_timer.expires_from_now(m_poll_interval);
+		m_timer.async_wait([this, self](const boost::system::error_code& ec) {
+			if (!ec) poll();
+		});
+	}
+
+	void finish(std::shared_ptr<msgpack::sbuffer> buffer_out) {
+		m_client->send(buffer_out);
+		m_client->resume();
+	}
+
+	boost::asio::steady_timer m_timer;
+	ptrClientConnection_t m_client;
+	ptrDevice_t m_device;
+	params_t m_params;
+	std::chrono::steady_clock::time_point m_deadline;
+	std::chrono::microseconds m_poll_interval;
+};
+
+// packs a histogram as [counts, underflow, overflow] in the client's byte order
+static void packHistogram(msgpack::packer<msgpack::sbuffer>& packer,
+		const histogram_t& result, bool little_endian)
+{
+	std::vector<uint32_t> counts(result.counts.size());
+	for (size_t i = 0; i < counts.size(); ++i) {
+		counts[i] = little_endian ? htole32(result.counts[i]) : htobe32(result.counts[i]);
+	}
+	size_t sz_counts = counts.size() * sizeof(uint32_t);
+	packer.pack_array(3);
+	packer.pack_bin(sz_counts);
+	packer.pack_bin_body((char*) counts.data(), sz_counts);
+	packer << result.underflow << result.overflow;
+}
+
+// packs threshold crossings as [n_events, indices, values] in the client's byte order
+static void packEvents(msgpack::packer<msgpack::sbuffer>& packer, uint64_t n_events,
+		const std::vector<uint32_t>& indices_host, const std::vector<uint16_t>& values_host,
+		bool little_endian)
+{
+	std::vector<uint32_t> indices(indices_host.size());
+	std::vector<uint16_t> values(values_host.size());
+	for (size_t i = 0; i < indices.size(); ++i) {
+		indices[i] = little_endian ? htole32(indices_host[i]) : htobe32(indices_host[i]);
+	}
+	for (size_t i = 0; i < values.size(); ++i) {
+		values[i] = little_endian ? htole16(values_host[i]) : htobe16(values_host[i]);
+	}
+	size_t sz_indices = indices.size() * sizeof(uint32_t);
+	size_t sz_values = values.size() * sizeof(uint16_t);
+	packer.pack_array(3);
+	packer << n_events;
+	packer.pack_bin(sz_indices);
+	packer.pack_bin_body((char*) indices.data(), sz_indices);
+	packer.pack_bin(sz_values);
+	packer.pack_bin_body((char*) values.data(), sz_values);
+}
+
+// packs an acquisition block as [seq, timestamp_us, data], data is the packed
+// histogram or events for jobs with a processing stage
+static void packAcquisitionBlock(msgpack::packer<msgpack::sbuffer>& packer,
+		const acquisition_block_t& block, bool little_endian)
+{
+	packer.pack_array(3);
+	packer << block.seq << block.timestamp_us;
+	if (block.processing == ACQUISITION_HISTOGRAM) {
+		packHistogram(packer, block.histogram, little_endian);
+		return;
+	}
+	if (block.processing == ACQUISITION_EVENTS) {
+		packEvents(packer, block.n_events, block.event_indices, block.event_values, little_endian);
+		return;
+	}
+	size_t n_bytes = block.data_be.size() * sizeof(uint16_t);
+	packer.pack_bin(n_bytes);
+	if (little_endian) {
+		std::vector<uint16_t> data(block.data_be.size());
+		swapBytes16(block.data_be.data(), data.data(), data.size());
+		packer.pack_bin_body((char*) data.data(), n_bytes);
+	} else {
+		packer.pack_bin_body((char*) block.data_be.data(), n_bytes);
+	}
+}
+
+DeviceRequestHandler::DeviceRequestHandler(boost::asio::io_service& io_service,
+		DeviceManager& manager, AcquisitionManager& acquisitions, WorkerPool& workers,
+		BlobCache& blob_cache, size_t shm_max_bytes) :
 		RequestHandler(),
-		m_manager(manager)
+		m_io_service(io_service),
+		m_manager(manager),
+		m_acquisitions(acquisitions),
+		m_workers(workers),
+		m_blob_cache(blob_cache),
+		m_shm_max_bytes(shm_max_bytes),
+		m_scheduler(io_service),
+		m_group_writer(io_service)
 {
+	// push new blocks of acquisition jobs to subscribed clients
+	m_acquisitions.setBlockCallback([this](const AcquisitionJob& job, ptrAcquisitionBlock_t block) {
+		acquisitionBlock(job, block);
+	});
+
 	// add handler functions for rpc commands
 
-	m_functions["devicelist"] = [&](msgpack_args_t& args, msgpack_reply_t& reply) {
+	m_functions["devicelist"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
 		std::list<std::string> devicelist;
 		m_manager.getDeviceList(devicelist);
 		RPC_REPLY_VALUE(reply, devicelist);
 	};
 
-	m_functions["reprogram"] = [&](msgpack_args_t& args, msgpack_reply_t& reply) {
+	m_functions["reprogram"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// programming runs in the background, the reply is sent when it has finished
+		// and progress is broadcast to all clients as RPC_RCODE_PROGRAMMING events
 		auto device = m_manager.getDevice(args.at(1).as<std::string>());
 		if (device) {
-			RPC_REPLY_VALUE(reply, m_manager.reprogramDevice(device));
+			bool started = m_manager.reprogramDevice(device, [client](std::exception_ptr error) {
+				if (!client->isOpen()) return;
+				auto buffer_out = std::make_shared<msgpack::sbuffer>();
+				msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+				try {
+					if (error) std::rethrow_exception(error);
+					RPC_REPLY_VALUE(packer_out, true);
+				} catch (const std::exception& e) {
+					std::cerr << "Exception in RPC call: " << e.what() << std::endl;
+					RPC_REPLY_ERROR(packer_out, e.what());
+				}
+				client->send(buffer_out);
+				client->resume();
+			});
+			if (started) {
+				client->suspend();
+			} else {
+				RPC_REPLY_VALUE(reply, false);
+			}
 		} else {
 			RPC_REPLY_ERROR(reply, "Unknown device");
 		}
 	};
 
-	m_functions["writereg"] = [&](msgpack_args_t& args, msgpack_reply_t& reply) {
+	m_functions["writereg"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
 		auto device = m_manager.getDevice(args.at(1).as<std::string>());
 		if (device) {
 			uint8_t addr = args.at(2).as<uint8_t>();
@@ -54,7 +346,7 @@ DeviceRequestHandler::DeviceRequestHandler(DeviceManager& manager) :
 		}
 	};
 
-	m_functions["readreg"] = [&](msgpack_args_t& args, msgpack_reply_t& reply) {
+	m_functions["readreg"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
 		auto device = m_manager.getDevice(args.at(1).as<std::string>());
 		if (device) {
 			uint8_t addr = args.at(2).as<uint8_t>();
@@ -67,11 +359,46 @@ DeviceRequestHandler::DeviceRequestHandler(DeviceManager& manager) :
 		}
 	};
 
-	m_functions["writeregn"] = [&](msgpack_args_t& args, msgpack_reply_t& reply) {
+	m_functions["reghistory"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// ["reghistory", serial, addr, port, t_from_ms, t_to_ms, max_points], reply with
+		// [times, values] of changes of a tracked register, times in ms since epoch
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			uint8_t addr = args.at(2).as<uint8_t>();
+			uint8_t port = args.at(3).as<uint8_t>();
+			uint64_t t_from = args.at(4).as<uint64_t>();
+			uint64_t t_to = args.at(5).as<uint64_t>();
+			uint32_t max_points = (args.size() > 6) ? args.at(6).as<uint32_t>() : 0;
+			std::vector<RegisterHistory::entry_t> entries;
+			device->regHistory(addr, port, t_from, t_to, max_points, entries);
+			reply.pack_array(2);
+			reply.pack_int8(RPC_RCODE_OK);
+			reply.pack_array(2);
+			reply.pack_array(entries.size());
+			for (auto& entry: entries) reply << entry.first;
+			reply.pack_array(entries.size());
+			for (auto& entry: entries) reply << entry.second;
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["writeregn"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
 		auto device = m_manager.getDevice(args.at(1).as<std::string>());
 		if (device) {
 			uint8_t addr = args.at(2).as<uint8_t>();
 			uint8_t port = args.at(3).as<uint8_t>();
+			bool little = isLittleEndian(client);
+			// decompress argument 4 off the event loop if compressed
+			if (isCompressed(args.at(4))) {
+				writeCompressed(client, args.at(4), [device, addr, port, little](std::vector<uint8_t>& data) {
+					uint16_t* words = (uint16_t*) data.data();
+					size_t n_words = data.size() / sizeof(uint16_t);
+					if (little) swapBytes16(words, words, n_words);
+					device->writeRegN(addr, port, words, n_words);
+				});
+				return;
+			}
 			// get argument 4 as uint16_t (be) buffer
 			if (args.at(4).type != msgpack::type::BIN) {
 				RPC_REPLY_ERROR(reply, "Invalid argument");
@@ -80,6 +407,13 @@ DeviceRequestHandler::DeviceRequestHandler(DeviceManager& manager) :
 			uint16_t* data_be = (uint16_t*) args.at(4).via.bin.ptr;
 			size_t n_words = args.at(4).via.bin.size / sizeof(uint16_t);
 
+			// the request buffer is read-only, swap little-endian data into a copy
+			std::vector<uint16_t> data_swapped;
+			if (little) {
+				data_swapped.resize(n_words);
+				swapBytes16(data_be, data_swapped.data(), n_words);
+				data_be = data_swapped.data();
+			}
 			device->writeRegN(addr, port, data_be, n_words);
 			RPC_REPLY_VALUE(reply, 0);
 		} else {
@@ -87,23 +421,288 @@ DeviceRequestHandler::DeviceRequestHandler(DeviceManager& manager) :
 		}
 	};
 
-	m_functions["readregn"] = [&](msgpack_args_t& args, msgpack_reply_t& reply) {
+	m_functions["writeregn_cached"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// ["writeregn_cached", serial, addr, port, sha256, payload], the payload is optional
+		// if the server has cached it before. Replies false if the payload is required.
+		// Cached payloads are always big-endian words, independent of the byte order setting.
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			uint8_t addr = args.at(2).as<uint8_t>();
+			uint8_t port = args.at(3).as<uint8_t>();
+			const msgpack::object& digest_obj = args.at(4);
+			if (digest_obj.type != msgpack::type::BIN || digest_obj.via.bin.size != sizeof(sha256_digest_t)) {
+				RPC_REPLY_ERROR(reply, "Invalid argument");
+				return;
+			}
+			sha256_digest_t digest;
+			std::copy(digest_obj.via.bin.ptr, digest_obj.via.bin.ptr + digest.size(), digest.begin());
+
+			if (args.size() > 5 && args.at(5).type == msgpack::type::BIN) {
+				const msgpack::object_bin& payload = args.at(5).via.bin;
+				if (payload.size % sizeof(uint16_t)) {
+					RPC_REPLY_ERROR(reply, "Invalid argument");
+					return;
+				}
+				// only payloads matching their digest are cached
+				if (sha256((const uint8_t*) payload.ptr, payload.size) != digest) {
+					RPC_REPLY_ERROR(reply, "Digest mismatch");
+					return;
+				}
+				m_blob_cache.put(digest, (const uint8_t*) payload.ptr, payload.size);
+				device->writeRegN(addr, port, (const uint16_t*) payload.ptr, payload.size / sizeof(uint16_t));
+				RPC_REPLY_VALUE(reply, true);
+				return;
+			}
+
+			ptrBlob_t blob = m_blob_cache.get(digest);
+			if (!blob) {
+				RPC_REPLY_VALUE(reply, false);
+				return;
+			}
+			device->writeRegN(addr, port, (const uint16_t*) blob->data(), blob->size() / sizeof(uint16_t));
+			RPC_REPLY_VALUE(reply, true);
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["writeregn_delta"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// ["writeregn_delta", serial, addr, port, data] writes the full contents of a shadowed port,
+		// ["writeregn_delta", serial, addr, port, [[offset, data], ...]] writes runs of words.
+		// Only words differing from the shadow are sent, replies the number of words sent.
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			uint8_t addr = args.at(2).as<uint8_t>();
+			uint8_t port = args.at(3).as<uint8_t>();
+			bool little = isLittleEndian(client);
+			const msgpack::object& data_obj = args.at(4);
+
+			// the request buffer is read-only, swap little-endian data into copies
+			std::list<std::vector<uint16_t>> data_swapped;
+			auto get_words = [&](const msgpack::object& obj, size_t& n_words) -> const uint16_t* {
+				const uint16_t* words = (const uint16_t*) obj.via.bin.ptr;
+				n_words = obj.via.bin.size / sizeof(uint16_t);
+				if (little) {
+					data_swapped.emplace_back(n_words);
+					swapBytes16(words, data_swapped.back().data(), n_words);
+					words = data_swapped.back().data();
+				}
+				return words;
+			};
+
+			if (data_obj.type == msgpack::type::BIN) {
+				size_t n_words;
+				const uint16_t* data_be = get_words(data_obj, n_words);
+				RPC_REPLY_VALUE(reply, device->writeRegNShadowed(addr, port, data_be, n_words));
+			} else if (data_obj.type == msgpack::type::ARRAY) {
+				std::vector<Device::run_t> runs;
+				for (auto& run_obj: data_obj.as<std::vector<msgpack::object>>()) {
+					auto run_args = run_obj.as<std::vector<msgpack::object>>();
+					if (run_args.size() != 2 || run_args[1].type != msgpack::type::BIN) {
+						RPC_REPLY_ERROR(reply, "Invalid argument");
+						return;
+					}
+					Device::run_t run;
+					run.offset = run_args[0].as<uint32_t>();
+					run.data_be = get_words(run_args[1], run.n);
+					runs.push_back(run);
+				}
+				RPC_REPLY_VALUE(reply, device->writeRegNRuns(addr, port, runs));
+			} else {
+				RPC_REPLY_ERROR(reply, "Invalid argument");
+			}
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["readregn"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			uint8_t addr = args.at(2).as<uint8_t>();
+			uint8_t port = args.at(3).as<uint8_t>();
+			uint32_t n_words = args.at(4).as<uint32_t>();
+			bool little = isLittleEndian(client);
+			replyBulk(client, reply, n_words*sizeof(uint16_t), [&](uint8_t* data) {
+				device->readRegN(addr, port, (uint16_t*) data, n_words);
+				if (little) swapBytes16((uint16_t*) data, (uint16_t*) data, n_words);
+			});
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["readregn_stream"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			uint8_t addr = args.at(2).as<uint8_t>();
+			uint8_t port = args.at(3).as<uint8_t>();
+			uint32_t n_words = args.at(4).as<uint32_t>();
+			bool little = isLittleEndian(client);
+			streamBulk(client, n_words*sizeof(uint16_t), RPC_STREAM_CHUNK_BYTES,
+					[device, addr, port, little](uint8_t* data, size_t offset, size_t n) {
+				device->readRegN(addr, port, (uint16_t*) data, n / sizeof(uint16_t));
+				if (little) swapBytes16((uint16_t*) data, (uint16_t*) data, n / sizeof(uint16_t));
+			});
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["readregn_reduce"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
 		auto device = m_manager.getDevice(args.at(1).as<std::string>());
 		if (device) {
 			uint8_t addr = args.at(2).as<uint8_t>();
 			uint8_t port = args.at(3).as<uint8_t>();
 			uint32_t n_words = args.at(4).as<uint32_t>();
+			std::string mode = args.at(5).as<std::string>();
+			uint32_t factor = args.at(6).as<uint32_t>();
+			if (factor == 0 || (mode != "minmax" && mode != "mean" && mode != "decimate")) {
+				RPC_REPLY_ERROR(reply, "Invalid argument");
+				return;
+			}
 			std::vector<uint16_t> data_be(n_words);
 			device->readRegN(addr, port, data_be.data(), n_words);
-			RPC_REPLY_BINARY(reply, (char*) data_be.data(), n_words*sizeof(uint16_t));
+
+			// reduce data in bins of factor words, reply with results in the client's byte order
+			bool little = isLittleEndian(client);
+			size_t n_out = reducedLength(n_words, factor);
+			size_t sz_out = n_out * sizeof(uint16_t);
+			std::vector<uint16_t> out_a(n_out), out_b;
+			if (mode == "minmax") {
+				out_b.resize(n_out);
+				reduceMinMax(data_be.data(), n_words, factor, out_a.data(), out_b.data());
+				if (little) {
+					swapBytes16(out_a.data(), out_a.data(), n_out);
+					swapBytes16(out_b.data(), out_b.data(), n_out);
+				}
+				reply.pack_array(2);
+				reply.pack_int8(RPC_RCODE_OK);
+				reply.pack_array(2);
+				reply.pack_bin(sz_out);
+				reply.pack_bin_body((char*) out_a.data(), sz_out);
+				reply.pack_bin(sz_out);
+				reply.pack_bin_body((char*) out_b.data(), sz_out);
+				return;
+			} else if (mode == "mean") {
+				reduceMean(data_be.data(), n_words, factor, out_a.data());
+			} else {
+				reduceDecimate(data_be.data(), n_words, factor, out_a.data());
+			}
+			if (little) swapBytes16(out_a.data(), out_a.data(), n_out);
+			RPC_REPLY_BINARY(reply, (char*) out_a.data(), sz_out);
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["readregn_histogram"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			uint8_t addr = args.at(2).as<uint8_t>();
+			uint8_t port = args.at(3).as<uint8_t>();
+			uint32_t n_words = args.at(4).as<uint32_t>();
+			uint16_t lo = args.at(5).as<uint16_t>();
+			uint16_t bin_width = args.at(6).as<uint16_t>();
+			uint32_t n_bins = args.at(7).as<uint32_t>();
+			if (bin_width == 0 || n_bins == 0 || n_bins > 0x10000) {
+				RPC_REPLY_ERROR(reply, "Invalid argument");
+				return;
+			}
+			bool little = isLittleEndian(client);
+			replyProcessed(client, n_words, [&](uint8_t* data) {
+				device->readRegN(addr, port, (uint16_t*) data, n_words);
+			}, [lo, bin_width, n_bins, little](const std::vector<uint16_t>& data_be, msgpack_reply_t& reply) {
+				histogram_t result;
+				histogram(data_be.data(), data_be.size(), lo, bin_width, n_bins, result);
+				reply.pack_array(2);
+				reply.pack_int8(RPC_RCODE_OK);
+				packHistogram(reply, result, little);
+			});
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["readregn_events"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			uint8_t addr = args.at(2).as<uint8_t>();
+			uint8_t port = args.at(3).as<uint8_t>();
+			uint32_t n_words = args.at(4).as<uint32_t>();
+			uint16_t threshold = args.at(5).as<uint16_t>();
+			std::string edge_str = args.at(6).as<std::string>();
+			uint32_t max_events = args.at(7).as<uint32_t>();
+			event_edge_t edge;
+			if (!parseEventEdge(edge_str, edge)) {
+				RPC_REPLY_ERROR(reply, "Invalid argument");
+				return;
+			}
+			bool little = isLittleEndian(client);
+			replyProcessed(client, n_words, [&](uint8_t* data) {
+				device->readRegN(addr, port, (uint16_t*) data, n_words);
+			}, [threshold, edge, max_events, little](const std::vector<uint16_t>& data_be, msgpack_reply_t& reply) {
+				// reply with total number of crossings, indices and values in the client's byte order
+				std::vector<uint32_t> indices;
+				std::vector<uint16_t> values;
+				uint64_t n_events = thresholdEvents(data_be.data(), data_be.size(), threshold, edge,
+						false, max_events, indices, values);
+				reply.pack_array(2);
+				reply.pack_int8(RPC_RCODE_OK);
+				packEvents(reply, n_events, indices, values, little);
+			});
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["triggered_read"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// ["triggered_read", serial, status_addr, status_port, mask, value,
+		//  data_addr, data_port, n_words, timeout_ms, poll_us, [rearm_addr, rearm_port, rearm_value]]
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			TriggeredRead::params_t params;
+			params.status_addr = args.at(2).as<uint8_t>();
+			params.status_port = args.at(3).as<uint8_t>();
+			params.mask = args.at(4).as<uint16_t>();
+			params.value = args.at(5).as<uint16_t>();
+			params.data_addr = args.at(6).as<uint8_t>();
+			params.data_port = args.at(7).as<uint8_t>();
+			params.n_words = args.at(8).as<uint32_t>();
+			// each poll is a synchronous read on the event loop, so polls are spaced and bounded
+			uint32_t timeout_ms = std::min(args.at(9).as<uint32_t>(), uint32_t(RPC_TRIGGER_TIMEOUT_MAX_MS));
+			uint32_t poll_us = (args.size() > 10 && args.at(10).type != msgpack::type::NIL) ?
+					args.at(10).as<uint32_t>() : RPC_TRIGGER_POLL_US;
+			poll_us = std::max(poll_us, uint32_t(RPC_TRIGGER_POLL_MIN_US));
+			params.rearm = args.size() > 11 && args.at(11).type != msgpack::type::NIL;
+			if (params.rearm) {
+				std::vector<uint16_t> rearm = args.at(11).as<std::vector<uint16_t>>();
+				if (rearm.size() != 3) {
+					RPC_REPLY_ERROR(reply, "Invalid argument");
+					return;
+				}
+				params.rearm_addr = rearm[0];
+				params.rearm_port = rearm[1];
+				params.rearm_value = rearm[2];
+			}
+			params.little_endian = isLittleEndian(client);
+			auto triggered_read = std::make_shared<TriggeredRead>(m_io_service, client, device, params,
+					std::chrono::milliseconds(timeout_ms), std::chrono::microseconds(poll_us));
+			triggered_read->start();
 		} else {
 			RPC_REPLY_ERROR(reply, "Unknown device");
 		}
 	};
 
-	m_functions["writeraw"] = [&](msgpack_args_t& args, msgpack_reply_t& reply) {
+	m_functions["writeraw"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
 		auto device = m_manager.getDevice(args.at(1).as<std::string>());
 		if (device) {
+			if (isCompressed(args.at(2))) {
+				writeCompressed(client, args.at(2), [device](std::vector<uint8_t>& data) {
+					device->writeRaw(data.data(), data.size());
+				});
+				return;
+			}
 			if (args.at(2).type != msgpack::type::BIN) {
 				RPC_REPLY_ERROR(reply, "Invalid argument");
 				return;
@@ -117,21 +716,615 @@ DeviceRequestHandler::DeviceRequestHandler(DeviceManager& manager) :
 		}
 	};
 
-	m_functions["readraw"] = [&](msgpack_args_t& args, msgpack_reply_t& reply) {
+	m_functions["readraw"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			uint32_t n_bytes = args.at(2).as<uint32_t>();
+			replyBulk(client, reply, n_bytes, [&](uint8_t* data) {
+				device->readRaw(data, n_bytes);
+			});
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["readraw_stream"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
 		auto device = m_manager.getDevice(args.at(1).as<std::string>());
 		if (device) {
 			uint32_t n_bytes = args.at(2).as<uint32_t>();
-			std::vector<uint8_t> datard(n_bytes);
-			device->readRaw(datard.data(), n_bytes);
-			RPC_REPLY_BINARY(reply, (char*) datard.data(), n_bytes);
+			streamBulk(client, n_bytes, RPC_STREAM_CHUNK_BYTES,
+					[device](uint8_t* data, size_t offset, size_t n) {
+				device->readRaw(data, n);
+			});
 		} else {
 			RPC_REPLY_ERROR(reply, "Unknown device");
 		}
 	};
+
+	m_functions["writeregn_begin"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			auto& session = m_sessions[client.get()];
+			if (session.uploads.size() >= RPC_UPLOADS_MAX) {
+				RPC_REPLY_ERROR(reply, "Too many unfinished uploads");
+				return;
+			}
+			upload_t upload = {device, false, args.at(2).as<uint8_t>(), args.at(3).as<uint8_t>(), 0, ""};
+			uint32_t id = ++session.upload_id;
+			session.uploads.insert(std::make_pair(id, std::move(upload)));
+			RPC_REPLY_VALUE(reply, id);
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["writeraw_begin"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto device = m_manager.getDevice(args.at(1).as<std::string>());
+		if (device) {
+			auto& session = m_sessions[client.get()];
+			if (session.uploads.size() >= RPC_UPLOADS_MAX) {
+				RPC_REPLY_ERROR(reply, "Too many unfinished uploads");
+				return;
+			}
+			upload_t upload = {device, true, 0, 0, 0, ""};
+			uint32_t id = ++session.upload_id;
+			session.uploads.insert(std::make_pair(id, std::move(upload)));
+			RPC_REPLY_VALUE(reply, id);
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["upload_chunk"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// chunks are forwarded to the device as they arrive and are not answered,
+		// errors are reported when finishing the upload
+		auto& uploads = m_sessions[client.get()].uploads;
+		auto it = uploads.find(args.at(1).as<uint32_t>());
+		if (it == uploads.end()) return;
+		upload_t& upload = it->second;
+		if (!upload.error.empty()) return;
+
+		const msgpack::object& chunk = args.at(2);
+		if (chunk.type != msgpack::type::BIN) {
+			upload.error = "Invalid argument";
+		} else if (chunk.via.bin.size > RPC_UPLOAD_CHUNK_MAX_BYTES) {
+			upload.error = "Chunk size exceeded";
+		} else if (!upload.raw && chunk.via.bin.size % sizeof(uint16_t)) {
+			upload.error = "Chunk size must be a multiple of the word size";
+		} else {
+			try {
+				if (upload.raw) {
+					upload.device->writeRaw((uint8_t*) chunk.via.bin.ptr, chunk.via.bin.size);
+				} else {
+					uint16_t* data_be = (uint16_t*) chunk.via.bin.ptr;
+					size_t n_words = chunk.via.bin.size / sizeof(uint16_t);
+					std::vector<uint16_t> data_swapped;
+					if (isLittleEndian(client)) {
+						data_swapped.resize(n_words);
+						swapBytes16(data_be, data_swapped.data(), n_words);
+						data_be = data_swapped.data();
+					}
+					upload.device->writeRegN(upload.addr, upload.port, data_be, n_words);
+				}
+				upload.n_bytes += chunk.via.bin.size;
+			} catch (const std::exception& e) {
+				upload.error = e.what();
+			}
+		}
+	};
+
+	m_functions["upload_end"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto& uploads = m_sessions[client.get()].uploads;
+		auto it = uploads.find(args.at(1).as<uint32_t>());
+		if (it == uploads.end()) {
+			RPC_REPLY_ERROR(reply, "Unknown upload");
+			return;
+		}
+		upload_t upload = std::move(it->second);
+		uploads.erase(it);
+		if (upload.error.empty()) {
+			RPC_REPLY_VALUE(reply, upload.n_bytes);
+		} else {
+			RPC_REPLY_ERROR(reply, upload.error);
+		}
+	};
+
+	m_functions["set_compression"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto& session = m_sessions[client.get()];
+		std::string method = args.at(1).as<std::string>();
+		if (method == "none") {
+			session.compression = false;
+		} else if (method == "lz4") {
+			if (!compressionAvailable()) {
+				RPC_REPLY_ERROR(reply, "Compression not supported");
+				return;
+			}
+			session.compression = true;
+			session.compression_min_bytes = (args.size() > 2) ?
+					args.at(2).as<uint32_t>() : RPC_COMPRESSION_MIN_BYTES;
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown compression method");
+			return;
+		}
+		RPC_REPLY_VALUE(reply, 0);
+	};
+
+	m_functions["set_byteorder"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// byte order of register data in bulk requests and replies of this connection
+		std::string order = args.at(1).as<std::string>();
+		if (order != "big" && order != "little") {
+			RPC_REPLY_ERROR(reply, "Unknown byte order");
+			return;
+		}
+		m_sessions[client.get()].little_endian = (order == "little");
+		RPC_REPLY_VALUE(reply, 0);
+	};
+
+	m_functions["acq_add"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// ["acq_add", name, serial, addr, port, n_words, interval_ms, history, processing], processing
+		// is nil, ["histogram", lo, bin_width, n_bins] or ["events", threshold, edge, max_events]
+		AcquisitionJob::description_t desc;
+		desc.name = args.at(1).as<std::string>();
+		desc.serial = args.at(2).as<std::string>();
+		desc.addr = args.at(3).as<uint8_t>();
+		desc.port = args.at(4).as<uint8_t>();
+		desc.n_words = args.at(5).as<uint32_t>();
+		desc.interval_ms = args.at(6).as<uint32_t>();
+		desc.history = (args.size() > 7) ? args.at(7).as<uint32_t>() : ACQUISITION_HISTORY_DEFAULT;
+		if (args.size() > 8 && args.at(8).type != msgpack::type::NIL) {
+			std::vector<msgpack::object> processing = args.at(8).as<std::vector<msgpack::object>>();
+			std::string type = processing.at(0).as<std::string>();
+			if (type == "histogram") {
+				desc.processing = ACQUISITION_HISTOGRAM;
+				desc.lo = processing.at(1).as<uint16_t>();
+				desc.bin_width = processing.at(2).as<uint16_t>();
+				desc.n_bins = processing.at(3).as<uint32_t>();
+			} else if (type == "events" && parseEventEdge(processing.at(2).as<std::string>(), desc.edge)) {
+				desc.processing = ACQUISITION_EVENTS;
+				desc.threshold = processing.at(1).as<uint16_t>();
+				desc.max_events = processing.at(3).as<uint32_t>();
+			} else {
+				RPC_REPLY_ERROR(reply, "Invalid argument");
+				return;
+			}
+		}
+		m_acquisitions.addJob(std::move(desc));
+		RPC_REPLY_VALUE(reply, 0);
+	};
+
+	m_functions["acq_remove"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		std::string name = args.at(1).as<std::string>();
+		if (m_acquisitions.removeJob(name)) {
+			m_acq_subscribers.erase(name);
+			RPC_REPLY_VALUE(reply, 0);
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown acquisition");
+		}
+	};
+
+	m_functions["acq_list"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// reply with [name, serial, addr, port, n_words, interval_ms, history, last_seq] per job
+		std::list<std::string> names;
+		m_acquisitions.getJobList(names);
+		reply.pack_array(2);
+		reply.pack_int8(RPC_RCODE_OK);
+		reply.pack_array(names.size());
+		for (auto& name: names) {
+			auto job = m_acquisitions.getJob(name);
+			auto& desc = job->description();
+			reply.pack_array(8);
+			reply << desc.name << desc.serial << desc.addr << desc.port << desc.n_words
+					<< desc.interval_ms << desc.history << job->lastSeq();
+		}
+	};
+
+	m_functions["acq_latest"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		auto job = m_acquisitions.getJob(args.at(1).as<std::string>());
+		if (job) {
+			// reply with nil if no block was acquired yet
+			auto block = job->latest();
+			reply.pack_array(2);
+			reply.pack_int8(RPC_RCODE_OK);
+			if (block) {
+				packAcquisitionBlock(reply, *block, isLittleEndian(client));
+			} else {
+				reply.pack_nil();
+			}
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown acquisition");
+		}
+	};
+
+	m_functions["acq_range"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// blocks starting at sequence number seq_first that are still in the history
+		auto job = m_acquisitions.getJob(args.at(1).as<std::string>());
+		if (job) {
+			std::list<ptrAcquisitionBlock_t> blocks;
+			job->range(args.at(2).as<uint64_t>(), args.at(3).as<uint32_t>(), blocks);
+			bool little = isLittleEndian(client);
+			reply.pack_array(2);
+			reply.pack_int8(RPC_RCODE_OK);
+			reply.pack_array(blocks.size());
+			for (auto& block: blocks) {
+				packAcquisitionBlock(reply, *block, little);
+			}
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown acquisition");
+		}
+	};
+
+	m_functions["acq_subscribe"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// new blocks are pushed to subscribers as RPC_RCODE_ACQ_BLOCK events
+		std::string name = args.at(1).as<std::string>();
+		bool enabled = (args.size() > 2) ? args.at(2).as<bool>() : true;
+		if (!m_acquisitions.getJob(name)) {
+			RPC_REPLY_ERROR(reply, "Unknown acquisition");
+			return;
+		}
+		if (enabled) {
+			m_acq_subscribers[name].insert(client);
+		} else {
+			m_acq_subscribers[name].erase(client);
+		}
+		RPC_REPLY_VALUE(reply, 0);
+	};
+
+	m_functions["server_time"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// monotonic clock of the server in us, reference for scheduled writes
+		uint64_t t_us = std::chrono::duration_cast<std::chrono::microseconds>(
+				WriteScheduler::clock_t::now().time_since_epoch()).count();
+		RPC_REPLY_VALUE(reply, t_us);
+	};
+
+	m_functions["schedule"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// ["schedule", base_us, [[serial, addr, port, value, offset_us], ...]], writes are
+		// executed at base_us + offset_us of the server clock, or relative to now if base_us is nil.
+		// Reply with [lateness_ns, duration_ns, error] per write once all were executed.
+		WriteScheduler::clock_t::time_point base = WriteScheduler::clock_t::now();
+		if (args.at(1).type != msgpack::type::NIL) {
+			base = WriteScheduler::clock_t::time_point(std::chrono::microseconds(args.at(1).as<uint64_t>()));
+		}
+		std::vector<msgpack::object> items = args.at(2).as<std::vector<msgpack::object>>();
+		std::vector<WriteScheduler::write_t> writes;
+		for (auto& item: items) {
+			std::vector<msgpack::object> fields = item.as<std::vector<msgpack::object>>();
+			auto device = m_manager.getDevice(fields.at(0).as<std::string>());
+			if (!device) {
+				RPC_REPLY_ERROR(reply, "Unknown device");
+				return;
+			}
+			WriteScheduler::write_t write;
+			write.device = device;
+			write.addr = fields.at(1).as<uint8_t>();
+			write.port = fields.at(2).as<uint8_t>();
+			write.value = fields.at(3).as<uint16_t>();
+			write.time = base + std::chrono::microseconds(fields.at(4).as<int64_t>());
+			writes.push_back(std::move(write));
+		}
+		client->suspend();
+		m_scheduler.schedule(std::move(writes), [client](const std::vector<WriteScheduler::result_t>& results) {
+			if (!client->isOpen()) return;
+			auto buffer_out = std::make_shared<msgpack::sbuffer>();
+			msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+			packer_out.pack_array(2);
+			packer_out.pack_int8(RPC_RCODE_OK);
+			packer_out.pack_array(results.size());
+			for (auto& result: results) {
+				packer_out.pack_array(3);
+				packer_out << result.lateness_ns << result.duration_ns;
+				if (result.error.empty()) {
+					packer_out.pack_nil();
+				} else {
+					packer_out << result.error;
+				}
+			}
+			client->send(buffer_out);
+			client->resume();
+		});
+	};
+
+	m_functions["groupwrite"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// ["groupwrite", serial_prefix | [serials], addr, port, value], writes all devices
+		// in parallel, reply with [serial, start_ns, done_ns, error] relative to the common start
+		std::vector<ptrDevice_t> devices;
+		if (args.at(1).type == msgpack::type::ARRAY) {
+			for (auto& serial: args.at(1).as<std::vector<std::string>>()) {
+				auto device = m_manager.getDevice(serial);
+				if (!device) {
+					RPC_REPLY_ERROR(reply, "Unknown device");
+					return;
+				}
+				devices.push_back(device);
+			}
+		} else {
+			std::list<ptrDevice_t> matching;
+			m_manager.getDevicesByPrefix(args.at(1).as<std::string>(), matching);
+			devices.assign(matching.begin(), matching.end());
+		}
+		uint8_t addr = args.at(2).as<uint8_t>();
+		uint8_t port = args.at(3).as<uint8_t>();
+		uint16_t value = args.at(4).as<uint16_t>();
+		client->suspend();
+		m_group_writer.write(devices, addr, port, value, [client](const std::vector<GroupWriter::result_t>& results) {
+			if (!client->isOpen()) return;
+			auto buffer_out = std::make_shared<msgpack::sbuffer>();
+			msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+			packer_out.pack_array(2);
+			packer_out.pack_int8(RPC_RCODE_OK);
+			packer_out.pack_array(results.size());
+			for (auto& result: results) {
+				packer_out.pack_array(4);
+				packer_out << result.serial << result.start_ns << result.done_ns;
+				if (result.error.empty()) {
+					packer_out.pack_nil();
+				} else {
+					packer_out << result.error;
+				}
+			}
+			client->send(buffer_out);
+			client->resume();
+		});
+	};
+
+	m_functions["seq_upload"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// programs are shared by all clients and replace programs of the same name
+		std::string name = args.at(1).as<std::string>();
+		if (args.at(2).type != msgpack::type::BIN) {
+			RPC_REPLY_ERROR(reply, "Invalid argument");
+			return;
+		}
+		const msgpack::object_bin& bin = args.at(2).via.bin;
+		auto program = std::make_shared<std::vector<uint8_t>>(bin.ptr, bin.ptr + bin.size);
+		validateSequencerProgram(*program);
+		m_programs[name] = program;
+		RPC_REPLY_VALUE(reply, program->size());
+	};
+
+	m_functions["seq_remove"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		if (m_programs.erase(args.at(1).as<std::string>())) {
+			RPC_REPLY_VALUE(reply, 0);
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown program");
+		}
+	};
+
+	m_functions["seq_run"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// ["seq_run", name, serial, max_steps], reply with [results, steps]
+		auto program = m_programs.find(args.at(1).as<std::string>());
+		if (program == m_programs.end()) {
+			RPC_REPLY_ERROR(reply, "Unknown program");
+			return;
+		}
+		auto device = m_manager.getDevice(args.at(2).as<std::string>());
+		if (device) {
+			uint64_t max_steps = (args.size() > 3) ? args.at(3).as<uint64_t>() : SEQ_MAX_STEPS_DEFAULT;
+			max_steps = std::min(max_steps, uint64_t(SEQ_MAX_STEPS_LIMIT));
+			bool little = isLittleEndian(client);
+			client->suspend();
+			auto run = std::make_shared<SequencerRun>(m_io_service, device, program->second, max_steps,
+					[client, little](std::exception_ptr error, const std::vector<uint16_t>& results, uint64_t steps) {
+				if (!client->isOpen()) return;
+				auto buffer_out = std::make_shared<msgpack::sbuffer>();
+				msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+				try {
+					if (error) std::rethrow_exception(error);
+					std::vector<uint16_t> data(results.size());
+					for (size_t i = 0; i < results.size(); ++i) {
+						data[i] = little ? htole16(results[i]) : htobe16(results[i]);
+					}
+					size_t n_bytes = data.size() * sizeof(uint16_t);
+					packer_out.pack_array(2);
+					packer_out.pack_int8(RPC_RCODE_OK);
+					packer_out.pack_array(2);
+					packer_out.pack_bin(n_bytes);
+					packer_out.pack_bin_body((char*) data.data(), n_bytes);
+					packer_out << steps;
+				} catch (const std::exception& e) {
+					std::cerr << "Exception in sequencer: " << e.what() << std::endl;
+					RPC_REPLY_ERROR(packer_out, e.what());
+				}
+				client->send(buffer_out);
+				client->resume();
+			});
+			m_sessions[client.get()].seq_run = run;
+			run->start();
+		} else {
+			RPC_REPLY_ERROR(reply, "Unknown device");
+		}
+	};
+
+	m_functions["shm_attach"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		if (!client->isLocal()) {
+			RPC_REPLY_ERROR(reply, "Shared memory requires a local connection");
+			return;
+		}
+		// the client may still hold regions of an attached ring, which must stay mapped
+		auto& session_ring = m_sessions[client.get()].shm_ring;
+		if (session_ring && session_ring->inUse()) {
+			RPC_REPLY_ERROR(reply, "Shared memory already attached and in use");
+			return;
+		}
+		size_t n_bytes = args.at(1).as<uint64_t>();
+		// rings of all clients share one budget, the ring being replaced does not count
+		size_t total_bytes = 0;
+		for (auto& session: m_sessions) {
+			if (session.first != client.get() && session.second.shm_ring)
+				total_bytes += session.second.shm_ring->size();
+		}
+		if (n_bytes > m_shm_max_bytes || total_bytes > m_shm_max_bytes - n_bytes) {
+			RPC_REPLY_ERROR(reply, "Shared memory limit exceeded");
+			return;
+		}
+		auto ring = std::make_shared<SharedMemoryRing>(n_bytes);
+		session_ring = ring;
+		// reply is sent along with the memory file descriptor
+		auto buffer_out = std::make_shared<msgpack::sbuffer>();
+		msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+		RPC_REPLY_VALUE(packer_out, ring->size());
+		client->send(buffer_out, ring->fd());
+	};
+
+	m_functions["shm_release"] = [&](msgpack_args_t& args, msgpack_reply_t& reply, ptrClientConnection_t& client) {
+		// release notifications from the client are not answered
+		auto& ring = m_sessions[client.get()].shm_ring;
+		if (ring) ring->release(args.at(1).as<uint64_t>());
+	};
+}
+
+void DeviceRequestHandler::replyBulk(ptrClientConnection_t& client, msgpack_reply_t& reply,
+		size_t n_bytes, read_func_t read_func)
+{
+	// read large payloads directly to shared memory if the client attached a ring
+	auto session = m_sessions.find(client.get());
+	if (n_bytes >= RPC_SHM_MIN_BYTES && session != m_sessions.end() && session->second.shm_ring) {
+		auto& ring = session->second.shm_ring;
+		size_t offset;
+		uint8_t* data = ring->allocate(n_bytes, offset);
+		if (data) {
+			try {
+				read_func(data);
+			} catch (...) {
+				ring->release(offset);
+				throw;
+			}
+			RPC_REPLY_SHM(reply, offset, n_bytes);
+			return;
+		}
+	}
+
+	// fall back to sending a copy of the data
+	auto data = std::make_shared<std::vector<uint8_t>>(n_bytes);
+	read_func(data->data());
+
+	// compress large payloads off the event loop if negotiated by the client
+	if (session != m_sessions.end() && session->second.compression &&
+			n_bytes >= session->second.compression_min_bytes) {
+		auto compressed = std::make_shared<std::vector<char>>();
+		auto is_compressed = std::make_shared<bool>(false);
+		client->suspend();
+		m_workers.run([data, compressed, is_compressed]() {
+			*is_compressed = compressLZ4(data->data(), data->size(), *compressed);
+		}, [client, data, compressed, is_compressed](std::exception_ptr error) {
+			if (!client->isOpen()) return;
+			auto buffer_out = std::make_shared<msgpack::sbuffer>();
+			msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+			if (*is_compressed) {
+				RPC_REPLY_EXT(packer_out, RPC_EXT_LZ4, compressed->data(), compressed->size());
+			} else {
+				RPC_REPLY_BINARY(packer_out, (char*) data->data(), data->size());
+			}
+			client->send(buffer_out);
+			client->resume();
+		});
+		return;
+	}
+
+	RPC_REPLY_BINARY(reply, (char*) data->data(), n_bytes);
+}
+
+bool DeviceRequestHandler::isCompressed(const msgpack::object& payload) {
+	return payload.type == msgpack::type::EXT && payload.via.ext.type() == RPC_EXT_LZ4;
+}
+
+bool DeviceRequestHandler::isLittleEndian(const ptrClientConnection_t& client) {
+	auto session = m_sessions.find(client.get());
+	return session != m_sessions.end() && session->second.little_endian;
+}
+
+void DeviceRequestHandler::writeCompressed(ptrClientConnection_t& client,
+		const msgpack::object& payload, write_func_t write_func)
+{
+	// the request object is only valid during the call, keep a copy of the payload
+	auto compressed = std::make_shared<std::vector<char>>(
+			payload.via.ext.data(), payload.via.ext.data() + payload.via.ext.size);
+	auto data = std::make_shared<std::vector<uint8_t>>();
+	client->suspend();
+	m_workers.run([compressed, data]() {
+		decompressLZ4(compressed->data(), compressed->size(), *data);
+	}, [client, data, write_func](std::exception_ptr error) {
+		if (!client->isOpen()) return;
+		auto buffer_out = std::make_shared<msgpack::sbuffer>();
+		msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+		try {
+			if (error) std::rethrow_exception(error);
+			write_func(*data);
+			RPC_REPLY_VALUE(packer_out, 0);
+		} catch (const std::exception& e) {
+			std::cerr << "Exception in RPC call: " << e.what() << std::endl;
+			RPC_REPLY_ERROR(packer_out, e.what());
+		}
+		client->send(buffer_out);
+		client->resume();
+	});
+}
+
+void DeviceRequestHandler::streamBulk(ptrClientConnection_t& client, size_t n_bytes,
+		size_t n_chunk, stream_func_t read_func)
+{
+	auto session = m_sessions.find(client.get());
+	ptrSharedMemoryRing_t ring = session != m_sessions.end() ? session->second.shm_ring : nullptr;
+	auto stream = std::make_shared<BulkStream>(client, n_bytes, n_chunk, std::move(read_func), ring);
+	stream->start();
+}
+
+void DeviceRequestHandler::replyProcessed(ptrClientConnection_t& client, size_t n_words,
+		read_func_t read_func, process_func_t process_func)
+{
+	// read on the event loop, process the data on the worker pool and reply with the result only
+	auto data = std::make_shared<std::vector<uint16_t>>(n_words);
+	read_func((uint8_t*) data->data());
+	auto buffer_out = std::make_shared<msgpack::sbuffer>();
+	client->suspend();
+	m_workers.run([data, buffer_out, process_func]() {
+		msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+		process_func(*data, packer_out);
+	}, [client, buffer_out](std::exception_ptr error) {
+		if (!client->isOpen()) return;
+		if (error) {
+			buffer_out->clear();
+			msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+			try {
+				std::rethrow_exception(error);
+			} catch (const std::exception& e) {
+				std::cerr << "Exception in RPC call: " << e.what() << std::endl;
+				RPC_REPLY_ERROR(packer_out, e.what());
+			}
+		}
+		client->send(buffer_out);
+		client->resume();
+	});
+}
+
+void DeviceRequestHandler::acquisitionBlock(const AcquisitionJob& job, ptrAcquisitionBlock_t block) {
+	auto subscribers = m_acq_subscribers.find(job.description().name);
+	if (subscribers == m_acq_subscribers.end()) return;
+	for (auto& client: subscribers->second) {
+		// skip subscribers that do not keep up, missed blocks can be fetched with acq_range
+		if (!client->isOpen() || client->pendingBytes() > RPC_ACQ_DROP_BYTES) continue;
+		auto buffer_out = std::make_shared<msgpack::sbuffer>();
+		msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+		packer_out.pack_array(3);
+		packer_out.pack_int8(RPC_RCODE_ACQ_BLOCK);
+		packer_out << job.description().name;
+		packAcquisitionBlock(packer_out, *block, isLittleEndian(client));
+		client->send(buffer_out);
+	}
+}
+
+void DeviceRequestHandler::clientClosed(ptrClientConnection_t client) {
+	auto session = m_sessions.find(client.get());
+	if (session != m_sessions.end()) {
+		auto run = session->second.seq_run.lock();
+		if (run) run->cancel();
+		m_sessions.erase(session);
+	}
+	for (auto& subscribers: m_acq_subscribers) {
+		subscribers.second.erase(client);
+	}
 }
 
 void DeviceRequestHandler::handleRequest(msgpack::object& request,
-		msgpack::packer<msgpack::sbuffer>& reply)
+		msgpack::packer<msgpack::sbuffer>& reply, ptrClientConnection_t client)
 {
 	// basic protocol: request is an array of objects
 	std::vector<msgpack::object> args;
@@ -159,7 +1352,7 @@ void DeviceRequestHandler::handleRequest(msgpack::object& request,
 
 	// try to call the function for the given command
 	try {
-		m_functions.at(cmd)(args, reply);
+		m_functions.at(cmd)(args, reply, client);
 	} catch (const std::exception& e) {
 		std::cerr << "Exception in RPC call: " << e.what() << std::endl;
 		RPC_REPLY_ERROR(reply, e.what());
@@ -10,15 +10,48 @@
 
 #include <map>
 #include <vector>
+#include <boost/asio/steady_timer.hpp>
 
+#include <set>
 #include "devices/DeviceManager.h"
+#include "devices/AcquisitionManager.h"
+#include "devices/Sequencer.h"
+#include "devices/WriteScheduler.h"
+#include "devices/GroupWriter.h"
 #include "network/RequestHandler.h"
+#include "network/SharedMemoryRing.h"
+#include "WorkerPool.h"
+#include "cache/BlobCache.h"
 
 #define RPC_RCODE_ERROR -1
 #define RPC_RCODE_OK 0
 #define RPC_RCODE_ADDED 1
 #define RPC_RCODE_REMOVED 2
 #define RPC_RCODE_REG_CHANGED 3
+#define RPC_RCODE_CHUNK 4
+#define RPC_RCODE_ACQ_BLOCK 5
+#define RPC_RCODE_PROGRAMMING 6
+
+#define RPC_EXT_SHM 1
+#define RPC_EXT_LZ4 2
+
+// minimum payload size for replies via shared memory
+#define RPC_SHM_MIN_BYTES (64*1024)
+// default minimum payload size for compressed replies
+#define RPC_COMPRESSION_MIN_BYTES (16*1024)
+// maximum size of a single chunk in chunked uploads
+#define RPC_UPLOAD_CHUNK_MAX_BYTES (1024*1024)
+// maximum number of unfinished chunked uploads per client
+#define RPC_UPLOADS_MAX 16
+// default and minimum interval between status polls of triggered reads, and longest wait
+#define RPC_TRIGGER_POLL_US 1000
+#define RPC_TRIGGER_POLL_MIN_US 500
+#define RPC_TRIGGER_TIMEOUT_MAX_MS 60000
+// chunk size of streamed replies and amount of unsent data before reading the next chunk
+#define RPC_STREAM_CHUNK_BYTES (DEVICE_PACKET_MAX_WORDS*sizeof(uint16_t))
+#define RPC_STREAM_DRAIN_BYTES (1024*1024)
+// unsent data above which acquisition blocks are not pushed to a subscriber
+#define RPC_ACQ_DROP_BYTES (16*1024*1024)
 
 #define RPC_REPLY_VALUE(PACKER, VAL) { \
 	PACKER.pack_array(2); \
@@ -33,6 +66,28 @@
 	PACKER.pack_bin_body(PTR, N); \
 }
 
+#define RPC_REPLY_EXT(PACKER, TYPE, PTR, N) { \
+	PACKER.pack_array(2); \
+	PACKER.pack_int8(RPC_RCODE_OK); \
+	PACKER.pack_ext(N, TYPE); \
+	PACKER.pack_ext_body(PTR, N); \
+}
+
+#define RPC_REPLY_SHM(PACKER, OFFSET, N) { \
+	uint64_t shm_desc[] = {htobe64(OFFSET), htobe64(N)}; \
+	PACKER.pack_array(2); \
+	PACKER.pack_int8(RPC_RCODE_OK); \
+	PACKER.pack_ext(sizeof(shm_desc), RPC_EXT_SHM); \
+	PACKER.pack_ext_body((char*) shm_desc, sizeof(shm_desc)); \
+}
+
+#define RPC_REPLY_CHUNK(PACKER, PTR, N) { \
+	PACKER.pack_array(2); \
+	PACKER.pack_int8(RPC_RCODE_CHUNK); \
+	PACKER.pack_bin(N); \
+	PACKER.pack_bin_body(PTR, N); \
+}
+
 #define RPC_REPLY_ERROR(PACKER, STR) { \
 	PACKER.pack_array(2); \
 	PACKER.pack_int8(RPC_RCODE_ERROR); \
@@ -57,24 +112,79 @@
 	PACKER << SERIAL << ADDR << PORT << VALUE; \
 }
 
+#define RPC_EVENT_PROGRAMMING(PACKER, SERIAL, PHASE, BYTES_DONE, BYTES_TOTAL, ELAPSED_MS) { \
+	PACKER.pack_array(6); \
+	PACKER.pack_int8(RPC_RCODE_PROGRAMMING); \
+	PACKER << SERIAL << PHASE << BYTES_DONE << BYTES_TOTAL << ELAPSED_MS; \
+}
+
 
 class DeviceRequestHandler : public RequestHandler {
 public:
 	typedef std::vector<msgpack::object> msgpack_args_t;
 	typedef msgpack::packer<msgpack::sbuffer> msgpack_reply_t;
-	typedef std::function<void(msgpack_args_t&, msgpack_reply_t&)> handler_func_t;
+	typedef std::function<void(msgpack_args_t&, msgpack_reply_t&, ptrClientConnection_t&)> handler_func_t;
+	typedef std::function<void(uint8_t*)> read_func_t;
+	typedef std::function<void(std::vector<uint8_t>&)> write_func_t;
+	typedef std::function<void(uint8_t*, size_t, size_t)> stream_func_t;
+	typedef std::function<void(const std::vector<uint16_t>&, msgpack_reply_t&)> process_func_t;
+
+	struct upload_t {
+		ptrDevice_t device;
+		bool raw;
+		uint8_t addr;
+		uint8_t port;
+		size_t n_bytes;
+		std::string error;
+	};
+
+	struct client_session_t {
+		ptrSharedMemoryRing_t shm_ring;
+		// sequence run the client waits for, cancelled when the client disconnects
+		std::weak_ptr<SequencerRun> seq_run;
+		std::map<uint32_t, upload_t> uploads;
+		uint32_t upload_id = 0;
+		bool compression = false;
+		size_t compression_min_bytes = RPC_COMPRESSION_MIN_BYTES;
+		bool little_endian = false;
+	};
 
 	DeviceRequestHandler(const DeviceRequestHandler&) = delete;
 	DeviceRequestHandler& operator=(const DeviceRequestHandler&) = delete;
-	explicit DeviceRequestHandler(DeviceManager& manager);
+	explicit DeviceRequestHandler(boost::asio::io_service& io_service,
+			DeviceManager& manager, AcquisitionManager& acquisitions, WorkerPool& workers,
+			BlobCache& blob_cache, size_t shm_max_bytes = SHM_TOTAL_DEFAULT_BYTES);
 	virtual ~DeviceRequestHandler() {};
 
 	virtual void handleRequest(msgpack::object& request,
-			msgpack::packer<msgpack::sbuffer>& reply);
+			msgpack::packer<msgpack::sbuffer>& reply, ptrClientConnection_t client);
+	virtual void clientClosed(ptrClientConnection_t client);
 
 private:
+	void replyBulk(ptrClientConnection_t& client, msgpack_reply_t& reply,
+			size_t n_bytes, read_func_t read_func);
+	bool isCompressed(const msgpack::object& payload);
+	bool isLittleEndian(const ptrClientConnection_t& client);
+	void writeCompressed(ptrClientConnection_t& client, const msgpack::object& payload,
+			write_func_t write_func);
+	void streamBulk(ptrClientConnection_t& client, size_t n_bytes, size_t n_chunk,
+			stream_func_t read_func);
+	void acquisitionBlock(const AcquisitionJob& job, ptrAcquisitionBlock_t block);
+	void replyProcessed(ptrClientConnection_t& client, size_t n_words,
+			read_func_t read_func, process_func_t process_func);
+
+	boost::asio::io_service& m_io_service;
 	DeviceManager& m_manager;
+	AcquisitionManager& m_acquisitions;
+	WorkerPool& m_workers;
+	BlobCache& m_blob_cache;
+	size_t m_shm_max_bytes;
+	WriteScheduler m_scheduler;
+	GroupWriter m_group_writer;
 	std::map<std::string, handler_func_t> m_functions;
+	std::map<ClientConnection*, client_session_t> m_sessions;
+	std::map<std::string, std::set<ptrClientConnection_t>> m_acq_subscribers;
+	std::map<std::string, ptrSequencerProgram_t> m_programs;
 };
 
 #endif /* DEVICEREQUESTHANDLER_H_ */
@@ -0,0 +1,54 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "WorkerPool.h"
+
+
+WorkerPool::WorkerPool(boost::asio::io_service& io_service, size_t n_threads) :
+		m_io_service(io_service),
+		m_worker_service(),
+		m_work(new boost::asio::io_service::work(m_worker_service)),
+		m_threads()
+{
+	if (n_threads == 0) n_threads = 1;
+	for (size_t i = 0; i < n_threads; ++i) {
+		m_threads.emplace_back([this]() {
+			m_worker_service.run();
+		});
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	stop();
+}
+
+void WorkerPool::stop() {
+	// finish pending jobs and join worker threads
+	m_work.reset();
+	for (auto& thread: m_threads) {
+		if (thread.joinable()) thread.join();
+	}
+	m_threads.clear();
+}
+
+void WorkerPool::run(job_func_t job, done_func_t done) {
+	m_worker_service.post([this, job, done]() {
+		std::exception_ptr error;
+		try {
+			job();
+		} catch (...) {
+			error = std::current_exception();
+		}
+		m_io_service.post([done, error]() {
+			done(error);
+		});
+	});
+}
+
+size_t WorkerPool::size() const {
+	return m_threads.size();
+}
@@ -0,0 +1,41 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+#include <boost/asio.hpp>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Pool of threads for jobs that should not block the event loop. Completion
+// handlers are invoked on the thread running the main io_service.
+class WorkerPool {
+public:
+	typedef std::function<void()> job_func_t;
+	typedef std::function<void(std::exception_ptr)> done_func_t;
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	WorkerPool(boost::asio::io_service& io_service, size_t n_threads);
+	virtual ~WorkerPool();
+	void stop();
+
+	void run(job_func_t job, done_func_t done);
+	size_t size() const;
+
+private:
+	boost::asio::io_service& m_io_service;
+	boost::asio::io_service m_worker_service;
+	std::unique_ptr<boost::asio::io_service::work> m_work;
+	std::vector<std::thread> m_threads;
+};
+
+#endif /* WORKERPOOL_H_ */
@@ -0,0 +1,108 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "BitstreamCache.h"
+#include "../devices/xc3sprog/ioftdi.h"
+#include <algorithm>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+
+
+BitstreamCache::BitstreamCache() :
+		m_mutex(),
+		m_entries()
+{
+}
+
+ptrBitstream_t BitstreamCache::get(const std::string& fname) {
+	struct stat st;
+	if (stat(fname.c_str(), &st) != 0)
+		throw std::runtime_error("Could not open bitfile");
+	int64_t mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+	int64_t size = st.st_size;
+
+	// the lock only covers the map, the first request for a version parses it
+	std::promise<ptrBitstream_t> promise;
+	std::shared_future<ptrBitstream_t> bitstream;
+	bool load = false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_entries.find(fname);
+		if (it != m_entries.end() && it->second.mtime_ns == mtime_ns && it->second.size == size) {
+			bitstream = it->second.bitstream;
+		} else {
+			// runs still holding a previous version keep it alive until they finish
+			bitstream = promise.get_future().share();
+			entry_t entry = {mtime_ns, size, bitstream};
+			m_entries[fname] = entry;
+			load = true;
+		}
+	}
+
+	if (load) {
+		try {
+			promise.set_value(_load(fname));
+		} catch (...) {
+			// waiting requests get the error, the next one tries again
+			promise.set_exception(std::current_exception());
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_entries.find(fname);
+			if (it != m_entries.end() && it->second.mtime_ns == mtime_ns && it->second.size == size)
+				m_entries.erase(it);
+		}
+	}
+	return bitstream.get();
+}
+
+ptrBitstream_t BitstreamCache::_load(const std::string& fname) {
+	auto bitstream = std::make_shared<bitstream_t>();
+	BitFile& bitfile = bitstream->bitfile;
+	FILE* fh = fopen(fname.c_str(), "rb");
+	if (!fh)
+		throw std::runtime_error("Could not open bitfile");
+	int r = bitfile.readFile(fh, STYLE_BIT);
+	fclose(fh);
+	if (r != 0 || bitfile.getLengthBytes() == 0)
+		throw std::runtime_error("Error processing bitfile");
+
+	// design field looks like "top.ncd;UserID=0x20160815;Version=...", bitgen
+	// writes 0xFFFFFFFF if no UserID was set, which identifies no design
+	std::string design(bitfile.getNCDFilename());
+	size_t pos = design.find("UserID=");
+	bitstream->has_usercode = false;
+	bitstream->usercode = 0;
+	if (pos != std::string::npos) {
+		const char* str = design.c_str() + pos + 7;
+		char* end;
+		unsigned long usercode = strtoul(str, &end, 0);
+		if (end != str && usercode < 0xFFFFFFFFUL) {
+			bitstream->has_usercode = true;
+			bitstream->usercode = uint32_t(usercode);
+		}
+	}
+
+	// precompile the command streams of all slices, the last one leaves SHIFT-DR
+	unsigned int length = bitfile.getLength();
+	for (unsigned int i = 0; i < length; i += PROGRESS_SLICE_BITS) {
+		unsigned int n = std::min(length - i, (unsigned int) PROGRESS_SLICE_BITS);
+		bitstream->slice_streams.emplace_back();
+		IOFtdi::compile_tdi(bitfile.getData() + i/8, n, i + n == length, bitstream->slice_streams.back());
+	}
+	return bitstream;
+}
+
+void BitstreamCache::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+}
+
+size_t BitstreamCache::size() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_entries.size();
+}
@@ -0,0 +1,60 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef CACHE_BITSTREAMCACHE_H_
+#define CACHE_BITSTREAMCACHE_H_
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "../devices/xc3sprog/bitfile.h"
+#include "../devices/xc3sprog/progalgxc3s.h"
+
+// Parsed bitstream and the MPSSE commands shifting its slices into a chain
+// with a single device, built once when the file is loaded.
+struct bitstream_t {
+	BitFile bitfile;
+	slice_streams_t slice_streams;
+	// UserID from the design field of the header, as set with bitgen -g UserID
+	bool has_usercode;
+	uint32_t usercode;
+};
+
+typedef std::shared_ptr<bitstream_t> ptrBitstream_t;
+
+// Parsed and bit-reversed bitstreams keyed by file path. A file is parsed again
+// when its modification time or size changed. Bitstreams are shared read-only
+// between programming runs, which may run on any thread. Files are parsed
+// outside the lock, concurrent requests for the same file wait for one parse.
+class BitstreamCache {
+public:
+	BitstreamCache(const BitstreamCache&) = delete;
+	BitstreamCache& operator=(const BitstreamCache&) = delete;
+	BitstreamCache();
+
+	// returns the parsed bitstream, throws if the file cannot be read or parsed
+	ptrBitstream_t get(const std::string& fname);
+	void clear();
+	size_t size();
+
+private:
+	struct entry_t {
+		int64_t mtime_ns;
+		int64_t size;
+		std::shared_future<ptrBitstream_t> bitstream;
+	};
+
+	static ptrBitstream_t _load(const std::string& fname);
+
+	std::mutex m_mutex;
+	std::map<std::string, entry_t> m_entries;
+};
+
+#endif /* CACHE_BITSTREAMCACHE_H_ */
@@ -0,0 +1,62 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "BlobCache.h"
+
+BlobCache::BlobCache(size_t max_bytes) :
+	m_max_bytes(max_bytes),
+	m_bytes(0),
+	m_lru(),
+	m_index()
+{
+}
+
+ptrBlob_t BlobCache::get(const sha256_digest_t& digest) {
+	auto it = m_index.find(digest);
+	if (it == m_index.end()) return nullptr;
+	m_lru.splice(m_lru.begin(), m_lru, it->second);
+	return it->second->second;
+}
+
+sha256_digest_t BlobCache::put(const uint8_t* data, size_t n) {
+	sha256_digest_t digest = sha256(data, n);
+	put(digest, data, n);
+	return digest;
+}
+
+void BlobCache::put(const sha256_digest_t& digest, const uint8_t* data, size_t n) {
+	if (get(digest)) return;
+	// blobs larger than the cache are not stored
+	if (n > m_max_bytes) return;
+
+	auto blob = std::make_shared<const std::vector<uint8_t>>(data, data + n);
+	m_lru.emplace_front(digest, blob);
+	m_index[digest] = m_lru.begin();
+	m_bytes += n;
+	evict();
+}
+
+void BlobCache::evict() {
+	while (m_bytes > m_max_bytes && !m_lru.empty()) {
+		auto& oldest = m_lru.back();
+		m_bytes -= oldest.second->size();
+		m_index.erase(oldest.first);
+		m_lru.pop_back();
+	}
+}
+
+size_t BlobCache::size() const {
+	return m_lru.size();
+}
+
+size_t BlobCache::bytes() const {
+	return m_bytes;
+}
+
+size_t BlobCache::maxBytes() const {
+	return m_max_bytes;
+}
@@ -0,0 +1,52 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef CACHE_BLOBCACHE_H_
+#define CACHE_BLOBCACHE_H_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "Sha256.h"
+
+#define BLOB_CACHE_DEFAULT_BYTES (256*1024*1024)
+
+typedef std::shared_ptr<const std::vector<uint8_t>> ptrBlob_t;
+
+// Content-addressed cache of payloads keyed by their SHA-256 digest. Least
+// recently used blobs are evicted when the memory limit is exceeded.
+class BlobCache {
+public:
+	BlobCache(const BlobCache&) = delete;
+	BlobCache& operator=(const BlobCache&) = delete;
+	explicit BlobCache(size_t max_bytes = BLOB_CACHE_DEFAULT_BYTES);
+
+	// returns the blob and marks it as recently used, nullptr if not cached
+	ptrBlob_t get(const sha256_digest_t& digest);
+	// stores a copy of the data and returns its digest
+	sha256_digest_t put(const uint8_t* data, size_t n);
+	// stores a copy of the data under a digest already computed by the caller
+	void put(const sha256_digest_t& digest, const uint8_t* data, size_t n);
+
+	size_t size() const;
+	size_t bytes() const;
+	size_t maxBytes() const;
+
+private:
+	typedef std::list<std::pair<sha256_digest_t, ptrBlob_t>> lru_t;
+
+	void evict();
+
+	size_t m_max_bytes;
+	size_t m_bytes;
+	lru_t m_lru;  // most recently used first
+	std::map<sha256_digest_t, lru_t::iterator> m_index;
+};
+
+#endif /* CACHE_BLOBCACHE_H_ */
@@ -0,0 +1,20 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef CACHE_SHA256_H_
+#define CACHE_SHA256_H_
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+typedef std::array<uint8_t, 32> sha256_digest_t;
+
+// SHA-256 digest of n bytes (FIPS 180-4)
+sha256_digest_t sha256(const uint8_t* data, size_t n);
+
+#endif /* CACHE_SHA256_H_ */
@@ -9,8 +9,12 @@
 
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include "json11.hpp"
+#include "../cache/BlobCache.h"
+#include "../network/SharedMemoryRing.h"
 
 Config Config::fromFile(std::string fname) {
 	// read config file
@@ -32,15 +36,83 @@ Config Config::fromFile(std::string fname) {
 		desc.name = device_item["name"].string_value();
 		desc.serial_prefix = device_item["prefix"].string_value();
 		desc.fname_bitfile = device_item["bitfile"].string_value();
+		// USERCODE as number or hex string, JSON has no hex literals
+		desc.has_usercode = device_item["usercode"].is_number() || device_item["usercode"].is_string();
+		desc.usercode = uint32_t(device_item["usercode"].number_value());
+		if (device_item["usercode"].is_string()) {
+			const std::string& str = device_item["usercode"].string_value();
+			size_t pos = 0;
+			unsigned long usercode = 0;
+			try {
+				usercode = std::stoul(str, &pos, 0);
+			} catch (const std::exception&) {
+				pos = 0;
+			}
+			if (pos == 0 || pos != str.size() || usercode > 0xFFFFFFFFUL)
+				throw std::runtime_error("Error reading configuration (invalid usercode \"" + str + "\" of " + desc.name + ")");
+			desc.usercode = uint32_t(usercode);
+		}
+		desc.jtag_clock_hz = device_item["jtag_clock_hz"].int_value();
 
 		for (auto& v: device_item["watchlist"].array_items()) {
 			Device::addr_port_t addr_port(v[0].int_value(), v[1].int_value());
 			desc.watchlist.push_back(addr_port);
 		}
+
+		for (auto& v: device_item["shadow"].array_items()) {
+			Device::shadow_config_t shadow = {
+				uint8_t(v[0].int_value()), uint8_t(v[1].int_value()),
+				uint8_t(v[2].int_value()), size_t(v[3].int_value())
+			};
+			desc.shadows.push_back(shadow);
+		}
 		config.device_descriptions.push_back(std::move(desc));
 	}
 
+	// periodic acquisition jobs
+	for (auto& acq_item: root["Acquisitions"].array_items()) {
+		AcquisitionJob::description_t desc;
+		desc.name = acq_item["name"].string_value();
+		desc.serial = acq_item["serial"].string_value();
+		desc.addr = acq_item["addr"].int_value();
+		desc.port = acq_item["port"].int_value();
+		desc.n_words = acq_item["n_words"].int_value();
+		desc.interval_ms = acq_item["interval_ms"].int_value();
+		// optional processing stage, "histogram": [lo, bin_width, n_bins] or
+		// "events": [threshold, edge, max_events]
+		if (acq_item["histogram"].is_array()) {
+			desc.processing = ACQUISITION_HISTOGRAM;
+			desc.lo = acq_item["histogram"][0].int_value();
+			desc.bin_width = acq_item["histogram"][1].int_value();
+			desc.n_bins = acq_item["histogram"][2].int_value();
+		} else if (acq_item["events"].is_array()) {
+			desc.processing = ACQUISITION_EVENTS;
+			desc.threshold = acq_item["events"][0].int_value();
+			if (!parseEventEdge(acq_item["events"][1].string_value(), desc.edge))
+				throw std::runtime_error("Error reading configuration (invalid edge of " + desc.name + ")");
+			desc.max_events = acq_item["events"][2].int_value();
+		}
+		desc.history = acq_item["history"].is_number() ?
+				acq_item["history"].int_value() : ACQUISITION_HISTORY_DEFAULT;
+		config.acquisitions.push_back(std::move(desc));
+	}
+
 	config.port = root["Server"]["port"].int_value();
+	config.local_socket = root["Server"]["local_socket"].string_value();
+	config.worker_threads = root["Server"]["worker_threads"].is_number() ?
+			root["Server"]["worker_threads"].int_value() : std::thread::hardware_concurrency();
+	config.programming_threads = root["Server"]["programming_threads"].is_number() ?
+			root["Server"]["programming_threads"].int_value() : DEVICE_MANAGER_PROGRAMMING_THREADS;
+	if (root["Server"]["jtag_transfer_kb"].is_number())
+		config.programmer_options.transfer_bytes = root["Server"]["jtag_transfer_kb"].int_value() * 1024;
+	if (root["Server"]["jtag_transfer_queue"].is_number())
+		config.programmer_options.transfer_queue = root["Server"]["jtag_transfer_queue"].int_value();
+	config.programmer_options.calibrate_clock = root["Server"]["jtag_calibrate"].bool_value();
+	config.preload_bitfiles = root["Server"]["preload_bitfiles"].bool_value();
+	config.blob_cache_bytes = root["Server"]["blob_cache_mb"].is_number() ?
+			size_t(root["Server"]["blob_cache_mb"].int_value()) * 1024 * 1024 : BLOB_CACHE_DEFAULT_BYTES;
+	config.shm_max_bytes = root["Server"]["shm_max_mb"].is_number() ?
+			size_t(root["Server"]["shm_max_mb"].int_value()) * 1024 * 1024 : SHM_TOTAL_DEFAULT_BYTES;
 
 	return config;
 }
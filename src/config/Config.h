@@ -9,10 +9,19 @@
 #define CONFIG_CONFIG_H_
 
 #include "../devices/DeviceManager.h"
+#include "../devices/AcquisitionManager.h"
 
 struct Config {
 	DeviceManager::device_descriptions_t device_descriptions;
+	AcquisitionManager::acquisition_descriptions_t acquisitions;
 	int port;
+	std::string local_socket;
+	int worker_threads;
+	int programming_threads;
+	programmer_options_t programmer_options;
+	bool preload_bitfiles;
+	size_t blob_cache_bytes;
+	size_t shm_max_bytes;
 
 	static Config fromFile(std::string fname);
 };
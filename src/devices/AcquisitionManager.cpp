@@ -0,0 +1,232 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "AcquisitionManager.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+AcquisitionJob::AcquisitionJob(boost::asio::io_service& io_service, DeviceManager& manager,
+		WorkerPool& workers, description_t desc, fn_block_cb cb) :
+	m_timer(io_service),
+	m_manager(manager),
+	m_workers(workers),
+	m_desc(std::move(desc)),
+	m_block_cb(std::move(cb)),
+	m_next(),
+	m_running(false),
+	m_processing(false),
+	m_seq(0),
+	m_blocks()
+{
+	if (m_desc.interval_ms == 0) throw std::invalid_argument("Invalid acquisition interval");
+	if (m_desc.n_words == 0 || m_desc.n_words > ACQUISITION_BLOCK_MAX_WORDS)
+		throw std::invalid_argument("Invalid acquisition block size");
+	if (m_desc.history == 0) m_desc.history = 1;
+
+	// memory kept per block, processed blocks only keep the result
+	uint64_t block_bytes = uint64_t(m_desc.n_words) * sizeof(uint16_t);
+	switch (m_desc.processing) {
+	case ACQUISITION_RAW:
+		break;
+	case ACQUISITION_HISTOGRAM:
+		if (m_desc.bin_width == 0 || m_desc.n_bins == 0 || m_desc.n_bins > 0x10000)
+			throw std::invalid_argument("Invalid acquisition histogram");
+		block_bytes = uint64_t(m_desc.n_bins) * sizeof(uint32_t);
+		break;
+	case ACQUISITION_EVENTS:
+		if (m_desc.edge < EVENT_EDGE_RISING || m_desc.edge > EVENT_EDGE_BOTH)
+			throw std::invalid_argument("Invalid acquisition events");
+		block_bytes = uint64_t(std::min(m_desc.max_events, m_desc.n_words)) * (sizeof(uint32_t) + sizeof(uint16_t));
+		break;
+	default:
+		throw std::invalid_argument("Invalid acquisition processing");
+	}
+	if (block_bytes * m_desc.history > ACQUISITION_HISTORY_MAX_BYTES)
+		throw std::invalid_argument("Acquisition history too large");
+}
+
+AcquisitionJob::~AcquisitionJob() {
+	stop();
+}
+
+void AcquisitionJob::start() {
+	m_running = true;
+	m_next = std::chrono::steady_clock::now();
+	schedule();
+}
+
+void AcquisitionJob::stop() {
+	m_running = false;
+	m_timer.cancel();
+}
+
+const AcquisitionJob::description_t& AcquisitionJob::description() const {
+	return m_desc;
+}
+
+uint64_t AcquisitionJob::lastSeq() const {
+	return m_seq;
+}
+
+ptrAcquisitionBlock_t AcquisitionJob::latest() const {
+	if (m_blocks.empty()) return nullptr;
+	return m_blocks.back();
+}
+
+void AcquisitionJob::range(uint64_t seq_first, size_t n, std::list<ptrAcquisitionBlock_t>& blocks) const {
+	// sequence numbers of the ring buffer are consecutive
+	if (m_blocks.empty()) return;
+	uint64_t seq_oldest = m_blocks.front()->seq;
+	size_t i = (seq_first > seq_oldest) ? seq_first - seq_oldest : 0;
+	for (; i < m_blocks.size() && blocks.size() < n; ++i) {
+		blocks.push_back(m_blocks[i]);
+	}
+}
+
+void AcquisitionJob::schedule() {
+	// schedule on absolute deadlines so the period does not drift with the read time,
+	// intervals that were missed entirely are skipped
+	auto interval = std::chrono::milliseconds(m_desc.interval_ms);
+	auto now = std::chrono::steady_clock::now();
+	m_next += interval;
+	if (m_next < now) {
+		m_next += ((now - m_next) / interval + 1) * interval;
+	}
+	m_timer.expires_at(m_next);
+	auto self(shared_from_this());
+	m_timer.async_wait([this, self](const boost::system::error_code& ec) {
+		if (!ec && m_running) {
+			acquire();
+			if (m_running) schedule();
+		}
+	});
+}
+
+void AcquisitionJob::acquire() {
+	if (m_processing) return;
+	auto device = m_manager.getDevice(m_desc.serial);
+	if (!device || m_manager.isProgramming(m_desc.serial) || !device->isOpen()) return;
+
+	auto block = std::make_shared<acquisition_block_t>();
+	block->timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	block->processing = m_desc.processing;
+	block->n_events = 0;
+	block->data_be.resize(m_desc.n_words);
+	try {
+		device->readRegN(m_desc.addr, m_desc.port, block->data_be.data(), m_desc.n_words);
+	} catch (std::exception& e) {
+		std::cerr << "Error in acquisition " << m_desc.name << ", " << e.what() << std::endl;
+		return;
+	}
+	if (m_desc.processing == ACQUISITION_RAW) {
+		store(block);
+		return;
+	}
+
+	// process outside the event loop, the block is stored once the result is ready
+	m_processing = true;
+	auto self(shared_from_this());
+	m_workers.run([this, self, block]() {
+		process(*block);
+	}, [this, self, block](std::exception_ptr error) {
+		m_processing = false;
+		if (error) {
+			try {
+				std::rethrow_exception(error);
+			} catch (const std::exception& e) {
+				std::cerr << "Error in acquisition " << m_desc.name << ", " << e.what() << std::endl;
+			}
+			return;
+		}
+		if (m_running) store(block);
+	});
+}
+
+void AcquisitionJob::process(acquisition_block_t& block) const {
+	if (m_desc.processing == ACQUISITION_HISTOGRAM) {
+		histogram(block.data_be.data(), block.data_be.size(), m_desc.lo, m_desc.bin_width,
+				m_desc.n_bins, block.histogram);
+	} else {
+		block.n_events = thresholdEvents(block.data_be.data(), block.data_be.size(), m_desc.threshold,
+				m_desc.edge, false, m_desc.max_events, block.event_indices, block.event_values);
+	}
+	std::vector<uint16_t>().swap(block.data_be);
+}
+
+void AcquisitionJob::store(std::shared_ptr<acquisition_block_t> block) {
+	block->seq = ++m_seq;
+
+	m_blocks.push_back(block);
+	while (m_blocks.size() > m_desc.history) {
+		m_blocks.pop_front();
+	}
+	if (m_block_cb) m_block_cb(*this, block);
+}
+
+AcquisitionManager::AcquisitionManager(boost::asio::io_service& io_service, DeviceManager& manager,
+		WorkerPool& workers, const acquisition_descriptions_t& descriptions) :
+	m_io_service(io_service),
+	m_manager(manager),
+	m_workers(workers),
+	m_jobs(),
+	m_block_cb()
+{
+	for (auto& desc: descriptions) {
+		addJob(desc);
+	}
+}
+
+AcquisitionManager::~AcquisitionManager() {
+	stop();
+}
+
+void AcquisitionManager::stop() {
+	for (auto& job: m_jobs) {
+		job.second->stop();
+	}
+}
+
+void AcquisitionManager::addJob(AcquisitionJob::description_t desc) {
+	if (m_jobs.find(desc.name) != m_jobs.end()) {
+		throw std::runtime_error("Acquisition already exists");
+	}
+	std::string name = desc.name;
+	// forward blocks to the callback registered at the time they are acquired
+	auto job = std::make_shared<AcquisitionJob>(m_io_service, m_manager, m_workers, std::move(desc),
+			[this](const AcquisitionJob& job, ptrAcquisitionBlock_t block) {
+		if (m_block_cb) m_block_cb(job, block);
+	});
+	m_jobs[name] = job;
+	job->start();
+}
+
+bool AcquisitionManager::removeJob(const std::string& name) {
+	auto it = m_jobs.find(name);
+	if (it == m_jobs.end()) return false;
+	it->second->stop();
+	m_jobs.erase(it);
+	return true;
+}
+
+ptrAcquisitionJob_t AcquisitionManager::getJob(const std::string& name) {
+	auto it = m_jobs.find(name);
+	if (it == m_jobs.end()) return nullptr;
+	return it->second;
+}
+
+void AcquisitionManager::getJobList(std::list<std::string>& list) {
+	list.clear();
+	for (auto& job: m_jobs) {
+		list.push_back(job.first);
+	}
+}
+
+void AcquisitionManager::setBlockCallback(AcquisitionJob::fn_block_cb cb) {
+	m_block_cb = cb;
+}
@@ -0,0 +1,129 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef DEVICES_ACQUISITIONMANAGER_H_
+#define DEVICES_ACQUISITIONMANAGER_H_
+
+#include <deque>
+#include <list>
+#include <boost/asio/steady_timer.hpp>
+
+#include "DeviceManager.h"
+#include "../WorkerPool.h"
+#include "../processing/Analysis.h"
+
+#define ACQUISITION_HISTORY_DEFAULT 16
+// limits of the block size and of the memory kept by the history of a job
+#define ACQUISITION_BLOCK_MAX_WORDS (1024*1024)
+#define ACQUISITION_HISTORY_MAX_BYTES (64*1024*1024)
+
+// optional processing of acquired blocks, only the result is kept and pushed
+enum acquisition_processing_t {
+	ACQUISITION_RAW = 0,
+	ACQUISITION_HISTOGRAM = 1,
+	ACQUISITION_EVENTS = 2
+};
+
+// Block of register data read by an acquisition job, data is big-endian. Jobs
+// with a processing stage keep the histogram or events instead of the data.
+struct acquisition_block_t {
+	uint64_t seq;
+	uint64_t timestamp_us;
+	acquisition_processing_t processing;
+	std::vector<uint16_t> data_be;
+	histogram_t histogram;
+	uint64_t n_events;
+	std::vector<uint32_t> event_indices;
+	std::vector<uint16_t> event_values;
+};
+typedef std::shared_ptr<const acquisition_block_t> ptrAcquisitionBlock_t;
+
+// Reads a register block periodically on a timer of the event loop and keeps
+// the latest blocks in a ring buffer. A processing stage runs on the worker
+// pool, intervals are skipped while the previous block is still processed.
+class AcquisitionJob : public std::enable_shared_from_this<AcquisitionJob> {
+public:
+	struct description_t {
+		std::string name;
+		std::string serial;
+		uint8_t addr;
+		uint8_t port;
+		uint32_t n_words;
+		uint32_t interval_ms;
+		uint32_t history;
+		acquisition_processing_t processing = ACQUISITION_RAW;
+		// ACQUISITION_HISTOGRAM, see histogram()
+		uint16_t lo = 0;
+		uint16_t bin_width = 1;
+		uint32_t n_bins = 0;
+		// ACQUISITION_EVENTS, see thresholdEvents()
+		uint16_t threshold = 0;
+		event_edge_t edge = EVENT_EDGE_RISING;
+		uint32_t max_events = 0;
+	};
+	typedef std::function<void(const AcquisitionJob&, ptrAcquisitionBlock_t)> fn_block_cb;
+
+	AcquisitionJob(const AcquisitionJob&) = delete;
+	AcquisitionJob& operator=(const AcquisitionJob&) = delete;
+	AcquisitionJob(boost::asio::io_service& io_service, DeviceManager& manager,
+			WorkerPool& workers, description_t desc, fn_block_cb cb);
+	virtual ~AcquisitionJob();
+	void start();
+	void stop();
+
+	const description_t& description() const;
+	uint64_t lastSeq() const;
+	ptrAcquisitionBlock_t latest() const;
+	void range(uint64_t seq_first, size_t n, std::list<ptrAcquisitionBlock_t>& blocks) const;
+
+private:
+	void acquire();
+	void schedule();
+	void process(acquisition_block_t& block) const;
+	void store(std::shared_ptr<acquisition_block_t> block);
+
+	boost::asio::steady_timer m_timer;
+	DeviceManager& m_manager;
+	WorkerPool& m_workers;
+	description_t m_desc;
+	fn_block_cb m_block_cb;
+	std::chrono::steady_clock::time_point m_next;
+	bool m_running;
+	bool m_processing;
+	uint64_t m_seq;
+	std::deque<ptrAcquisitionBlock_t> m_blocks;
+};
+
+typedef std::shared_ptr<AcquisitionJob> ptrAcquisitionJob_t;
+
+class AcquisitionManager {
+public:
+	typedef std::list<AcquisitionJob::description_t> acquisition_descriptions_t;
+
+	AcquisitionManager(const AcquisitionManager&) = delete;
+	AcquisitionManager& operator=(const AcquisitionManager&) = delete;
+	AcquisitionManager(boost::asio::io_service& io_service, DeviceManager& manager,
+			WorkerPool& workers, const acquisition_descriptions_t& descriptions);
+	virtual ~AcquisitionManager();
+	void stop();
+
+	void addJob(AcquisitionJob::description_t desc);
+	bool removeJob(const std::string& name);
+	ptrAcquisitionJob_t getJob(const std::string& name);
+	void getJobList(std::list<std::string>& list);
+
+	void setBlockCallback(AcquisitionJob::fn_block_cb cb);
+
+private:
+	boost::asio::io_service& m_io_service;
+	DeviceManager& m_manager;
+	WorkerPool& m_workers;
+	std::map<std::string, ptrAcquisitionJob_t> m_jobs;
+	AcquisitionJob::fn_block_cb m_block_cb;
+};
+
+#endif /* DEVICES_ACQUISITIONMANAGER_H_ */
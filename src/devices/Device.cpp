@@ -16,12 +16,20 @@
 #define CMD_READREG_N 3
 #define CMD_WRITEREG_N 4
 
+static uint64_t timestamp_ms() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+}
 
 Device::Device(libusb_device* dev, std::string name) :
 		m_name(std::move(name)),
 		m_dev(dev),
 		m_ftdi(nullptr),
-		m_tracked_regs()
+		m_open(false),
+		m_tracked_regs(),
+		m_reg_history(),
+		m_shadows(),
+		m_mutex()
 {
 	open();
 }
@@ -31,11 +39,12 @@ Device::~Device() {
 }
 
 bool Device::isOpen() {
-	return bool(m_ftdi);
+	return m_open;
 }
 
 void Device::open() {
-	if (isOpen()) return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_ftdi) return;
 
 	// open FTDI interface A
 	ftdi_context* ftdi_a;
@@ -95,9 +104,16 @@ void Device::open() {
 	};
 
 	m_ftdi = ftdi_a;
+	m_open = true;
 }
 
 void Device::close() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	// device memory does not survive reprogramming
+	for (auto& shadow: m_shadows) {
+		shadow.second.valid = false;
+	}
+	m_open = false;
 	if (m_ftdi) {
 		ftdi_set_bitmode(m_ftdi, 0xfb, BITMODE_RESET);
 		ftdi_usb_close(m_ftdi);
@@ -106,6 +122,11 @@ void Device::close() {
 	}
 }
 
+void Device::_requireOpen() {
+	// the device is closed while being reprogrammed
+	if (!m_ftdi) throw std::runtime_error("Device not open");
+}
+
 void ftdi_read_data_wait(struct ftdi_context *ftdi, unsigned char *buf, int size) {
 	// TODO: proper timeout implementation
 
@@ -134,6 +155,8 @@ void ftdi_read_data_wait(struct ftdi_context *ftdi, unsigned char *buf, int size
 }
 
 void Device::writeRaw(const uint8_t* data, const size_t n) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	_requireOpen();
 	if (n == 0) return;
 	// send N bytes to device
 	size_t n_sent = 0;
@@ -148,12 +171,20 @@ void Device::writeRaw(const uint8_t* data, const size_t n) {
 }
 
 void Device::readRaw(uint8_t* data, const size_t n) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	_requireOpen();
 	if (n == 0) return;
 	// read N bytes from device
 	ftdi_read_data_wait(m_ftdi, data, n);
 }
 
 void Device::writeReg(uint8_t addr, uint8_t port, uint16_t value) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	_writeReg(addr, port, value);
+}
+
+void Device::_writeReg(uint8_t addr, uint8_t port, uint16_t value) {
+	_requireOpen();
 	// send register write command
 	uint16_t wr_cmd[] = {
 			htobe16((CMD_WRITEREG << 12) | ((addr & 0x3f) << 6) | (port & 0x3f)),
@@ -166,6 +197,8 @@ void Device::writeReg(uint8_t addr, uint8_t port, uint16_t value) {
 }
 
 void Device::readReg(uint8_t addr, uint8_t port, uint16_t* value) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	_requireOpen();
 	// send register read command
 	uint16_t rd_cmd[] = {
 			htobe16((CMD_READREG << 12) | ((addr & 0x3f) << 6) | (port & 0x3f))
@@ -185,16 +218,26 @@ void Device::readReg(uint8_t addr, uint8_t port, uint16_t* value) {
 	if (it != m_tracked_regs.end()) {
 		uint16_t value_old = it->second;
 		it->second = *value;
+		m_reg_history[it->first].record(timestamp_ms(), *value);
 		if (*value != value_old && m_device_reg_change_cb) m_device_reg_change_cb(m_name, addr, port, *value);
 	}
 }
 
 void Device::writeRegN(uint8_t addr, uint8_t port, const uint16_t* data_be, size_t n) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	// contents of a shadowed port are unknown after writes bypassing the shadow
+	auto shadow = m_shadows.find(addr_port_t(addr, port));
+	if (shadow != m_shadows.end()) shadow->second.valid = false;
+	_writeRegN(addr, port, data_be, n);
+}
+
+void Device::_writeRegN(uint8_t addr, uint8_t port, const uint16_t* data_be, size_t n) {
+	_requireOpen();
 	if (n == 0) return;
 	// send N words to register
 
 	// packet length encoded as 16bit unsigned, send data in chunks of n_packet_max
-	const size_t n_packet_max = (1<<16)-1;
+	const size_t n_packet_max = DEVICE_PACKET_MAX_WORDS;
 	uint16_t out_buffer[2 + n_packet_max];
 	out_buffer[0] = htobe16((CMD_WRITEREG_N << 12) | ((addr & 0x3f) << 6) | (port & 0x3f));
 
@@ -222,11 +265,13 @@ void Device::writeRegN(uint8_t addr, uint8_t port, const uint16_t* data_be, size
 }
 
 void Device::readRegN(uint8_t addr, uint8_t port, uint16_t* data_be, size_t n) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	_requireOpen();
 	if (n == 0) return;
 	// read N words from register
 
 	// packet length encoded as 16bit unsigned, read data in chunks of n_packet_max
-	const size_t n_packet_max = (1<<16)-1;
+	const size_t n_packet_max = DEVICE_PACKET_MAX_WORDS;
 	uint16_t rdn_cmd[] = {
 			htobe16((CMD_READREG_N << 12) | ((addr & 0x3f) << 6) | (port & 0x3f)),
 			0
@@ -251,16 +296,20 @@ void Device::readRegN(uint8_t addr, uint8_t port, uint16_t* data_be, size_t n) {
 }
 
 void Device::trackReg(uint8_t addr, uint8_t port, bool enabled) {
+	std::lock_guard<std::mutex> lock(m_mutex);
 	addr_port_t addr_port(addr, port);
 	if (enabled) {
 		m_tracked_regs.insert(std::make_pair(addr_port, (uint16_t) 0));
 	} else {
 		m_tracked_regs.erase(addr_port);
+		m_reg_history.erase(addr_port);
 	}
 }
 
 void Device::updateTrackedRegs() {
+	std::lock_guard<std::mutex> lock(m_mutex);
 	if (m_tracked_regs.empty()) return;
+	_requireOpen();
 	// send multiple register read commands
 	uint16_t rd_cmd[m_tracked_regs.size()];
 	{
@@ -281,6 +330,7 @@ void Device::updateTrackedRegs() {
 	ftdi_read_data_wait(m_ftdi, (unsigned char*) &values_be, sizeof(values_be));
 
 	// store results and invoke callback
+	uint64_t t_ms = timestamp_ms();
 	int i = 0;
 	for (auto& kv: m_tracked_regs) {
 		uint8_t addr(kv.first.first);
@@ -288,10 +338,114 @@ void Device::updateTrackedRegs() {
 		uint16_t value_old = kv.second;
 		uint16_t value = be16toh(values_be[i++]);
 		kv.second = value;
+		m_reg_history[kv.first].record(t_ms, value);
 		if (value != value_old && m_device_reg_change_cb) m_device_reg_change_cb(m_name, addr, port, value);
 	}
 }
 
+void Device::regHistory(uint8_t addr, uint8_t port, uint64_t t_from_ms, uint64_t t_to_ms,
+		size_t max_points, std::vector<RegisterHistory::entry_t>& entries)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_reg_history.find(addr_port_t(addr, port));
+	if (it == m_reg_history.end()) {
+		if (m_tracked_regs.find(addr_port_t(addr, port)) == m_tracked_regs.end()) {
+			throw std::runtime_error("Register not tracked");
+		}
+		entries.clear();
+		return;
+	}
+	it->second.query(t_from_ms, t_to_ms, max_points, entries);
+}
+
+void Device::addShadow(uint8_t addr, uint8_t port, uint8_t offset_port, size_t n_words) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (n_words == 0 || n_words > DEVICE_SHADOW_MAX_WORDS) {
+		throw std::invalid_argument("Invalid shadow size");
+	}
+	shadow_t shadow;
+	shadow.offset_port = offset_port;
+	shadow.data_be.assign(n_words, 0);
+	shadow.valid = false;
+	m_shadows[addr_port_t(addr, port)] = std::move(shadow);
+}
+
+Device::shadow_t& Device::_getShadow(uint8_t addr, uint8_t port) {
+	auto it = m_shadows.find(addr_port_t(addr, port));
+	if (it == m_shadows.end()) throw std::runtime_error("Port not shadowed");
+	return it->second;
+}
+
+void Device::_writeRun(uint8_t addr, uint8_t port, shadow_t& shadow, size_t offset,
+		const uint16_t* data_be, size_t n)
+{
+	// set the write offset of the firmware, then send the words of the run
+	_writeReg(addr, shadow.offset_port, offset);
+	_writeRegN(addr, port, data_be, n);
+	std::copy(data_be, data_be + n, shadow.data_be.begin() + offset);
+}
+
+size_t Device::writeRegNShadowed(uint8_t addr, uint8_t port, const uint16_t* data_be, size_t n) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	shadow_t& shadow = _getShadow(addr, port);
+	if (n != shadow.data_be.size()) throw std::invalid_argument("Size does not match shadow");
+
+	// send everything if the device contents are unknown
+	if (!shadow.valid) {
+		_writeRun(addr, port, shadow, 0, data_be, n);
+		shadow.valid = true;
+		return n;
+	}
+
+	// send runs of changed words, runs separated by few unchanged words are merged
+	// as every run costs an offset write and a packet header
+	size_t n_sent = 0;
+	size_t i = 0;
+	while (i < n) {
+		if (data_be[i] == shadow.data_be[i]) {
+			++i;
+			continue;
+		}
+		size_t begin = i, end = i + 1, gap = 0;
+		for (i = end; i < n && gap <= DEVICE_SHADOW_MERGE_GAP; ++i) {
+			if (data_be[i] != shadow.data_be[i]) {
+				end = i + 1;
+				gap = 0;
+			} else {
+				++gap;
+			}
+		}
+		i = end;
+		try {
+			_writeRun(addr, port, shadow, begin, data_be + begin, end - begin);
+		} catch (...) {
+			shadow.valid = false;
+			throw;
+		}
+		n_sent += end - begin;
+	}
+	return n_sent;
+}
+
+size_t Device::writeRegNRuns(uint8_t addr, uint8_t port, const std::vector<run_t>& runs) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	shadow_t& shadow = _getShadow(addr, port);
+	for (auto& run: runs) {
+		if (run.offset + run.n > shadow.data_be.size()) throw std::out_of_range("Run exceeds shadow");
+	}
+	size_t n_sent = 0;
+	for (auto& run: runs) {
+		try {
+			_writeRun(addr, port, shadow, run.offset, run.data_be, run.n);
+		} catch (...) {
+			shadow.valid = false;
+			throw;
+		}
+		n_sent += run.n;
+	}
+	return n_sent;
+}
+
 void Device::setRegChangedCallback(fn_device_reg_changed_cb cb) {
 	m_device_reg_change_cb = std::move(cb);
 }
@@ -8,16 +8,41 @@
 #ifndef DEVICES_DEVICE_H_
 #define DEVICES_DEVICE_H_
 
+#include <atomic>
+#include <mutex>
 #include "../libusb_asio/libusb_service.h"
+#include "RegisterHistory.h"
 
 struct ftdi_context;
 
+// packet length of register transfers is encoded as 16bit unsigned
+#define DEVICE_PACKET_MAX_WORDS ((1<<16)-1)
+// shadowed ports are addressed by a 16bit offset register
+#define DEVICE_SHADOW_MAX_WORDS (1<<16)
+// unchanged words between changed runs of a shadowed port that are sent anyway
+#define DEVICE_SHADOW_MERGE_GAP 4
+
 typedef std::function<void(const std::string&, uint8_t, uint8_t, uint16_t)> fn_device_reg_changed_cb;
 
 class Device : public std::enable_shared_from_this<Device> {
 public:
 	typedef std::pair<uint8_t, uint8_t> addr_port_t;
 
+	// Shadowed ports keep a copy of the device memory behind a port. The firmware
+	// sets the write offset of the port when offset_port is written.
+	struct shadow_config_t {
+		uint8_t addr;
+		uint8_t port;
+		uint8_t offset_port;
+		size_t n_words;
+	};
+
+	struct run_t {
+		size_t offset;
+		const uint16_t* data_be;
+		size_t n;
+	};
+
 	Device(const Device&) = delete;
 	Device& operator=(const Device&) = delete;
 	Device(libusb_device* dev, std::string name);
@@ -39,13 +64,39 @@ public:
 	void trackReg(uint8_t addr, uint8_t port, bool enabled=true);
 	void updateTrackedRegs();
 	void setRegChangedCallback(fn_device_reg_changed_cb cb);
+	void regHistory(uint8_t addr, uint8_t port, uint64_t t_from_ms, uint64_t t_to_ms,
+			size_t max_points, std::vector<RegisterHistory::entry_t>& entries);
+
+	// write full contents or runs of words to a shadowed port, returns the number of words sent
+	void addShadow(uint8_t addr, uint8_t port, uint8_t offset_port, size_t n_words);
+	size_t writeRegNShadowed(uint8_t addr, uint8_t port, const uint16_t* data_be, size_t n);
+	size_t writeRegNRuns(uint8_t addr, uint8_t port, const std::vector<run_t>& runs);
 
 private:
+	struct shadow_t {
+		uint8_t offset_port;
+		std::vector<uint16_t> data_be;
+		bool valid;
+	};
+
+	void _requireOpen();
+	void _writeReg(uint8_t addr, uint8_t port, uint16_t value);
+	void _writeRegN(uint8_t addr, uint8_t port, const uint16_t* data_be, size_t n);
+	shadow_t& _getShadow(uint8_t addr, uint8_t port);
+	void _writeRun(uint8_t addr, uint8_t port, shadow_t& shadow, size_t offset,
+			const uint16_t* data_be, size_t n);
+
 	const std::string m_name;
 	libusb_device* m_dev;
 	ftdi_context* m_ftdi;
+	// set under m_mutex, readable without it while a programming thread reopens the device
+	std::atomic<bool> m_open;
 	std::map<addr_port_t, uint16_t> m_tracked_regs;
+	std::map<addr_port_t, RegisterHistory> m_reg_history;
+	std::map<addr_port_t, shadow_t> m_shadows;
 	fn_device_reg_changed_cb m_device_reg_change_cb;
+	// device operations may be issued from the scheduler thread
+	std::mutex m_mutex;
 };
 
 typedef std::shared_ptr<Device> ptrDevice_t;
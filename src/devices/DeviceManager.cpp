@@ -61,7 +61,10 @@ void getUsbDeviceStrings(libusb_device* dev,
 
 DeviceManager::DeviceManager(boost::asio::io_service& io_service,
 		boost::asio::libusb_service& usb_service,
-		device_descriptions_t device_descriptions) :
+		device_descriptions_t device_descriptions,
+		BitstreamCache& bitstreams,
+		size_t programming_threads,
+		const programmer_options_t& programmer_options) :
 	m_io_service(io_service),
 	m_timer(io_service),
 	m_libusb_service(usb_service),
@@ -70,7 +73,14 @@ DeviceManager::DeviceManager(boost::asio::io_service& io_service,
 	m_serial_map(),
 	m_device_added_cb(),
 	m_device_removed_cb(),
-	m_device_reg_change_cb()
+	m_device_reg_change_cb(),
+	m_device_programming_cb(),
+	m_bitstreams(bitstreams),
+	m_programmers(io_service, programming_threads),
+	m_programmer_options(programmer_options),
+	m_jtag_clocks(),
+	m_programming(),
+	m_pending_map()
 {
 	// libusb hotplug handler for FTDI devices
 	// don't communicate with the device from within the hotplug handler, defer to event loop
@@ -100,7 +110,7 @@ DeviceManager::~DeviceManager() {
 
 void DeviceManager::_usbDeviceAdded(libusb_device* dev) {
 	// filter out spurious events just in case
-	if (hasDevice(dev))
+	if (hasDevice(dev) || m_pending_map.find(dev) != m_pending_map.end())
 		return;
 
 	try {
@@ -110,7 +120,7 @@ void DeviceManager::_usbDeviceAdded(libusb_device* dev) {
 		std::cout << "New device: " << product << ", " << manufacturer << ", " << serial << std::endl;
 
 		// make sure the serial is unique
-		if (hasSerial(serial)) {
+		if (hasSerial(serial) || isProgramming(serial)) {
 			std::cerr << "Not adding device with duplicate serial=" << serial << std::endl;
 			return;
 		}
@@ -125,23 +135,40 @@ void DeviceManager::_usbDeviceAdded(libusb_device* dev) {
 		// create new device, this initialization process may also bring back stalled devices
 		std::cout << "Adding " << serial << ": " << desc->name << std::endl;
 		auto device = std::make_shared<Device>(dev, serial);
+		for (auto& shadow: desc->shadows)
+			device->addShadow(shadow.addr, shadow.port, shadow.offset_port, shadow.n_words);
 
-		// program the device if bitfile is defined
-		reprogramDevice(device);
-
-		// add new device to manager
-		m_device_map.insert(std::make_pair(dev, device->shared_from_this()));
-		m_serial_map.insert(std::make_pair(device->name(), device->shared_from_this()));
-
-		// emit added callback
-		if (m_device_added_cb) m_device_added_cb(device->name());  // TODO: post callback to asio loop?
+		if (desc->fname_bitfile.empty()) {
+			_addDevice(device);
+			return;
+		}
 
-		// setup register tracking information and set callback
-		for (auto& addr_port: desc->watchlist)
-			device->trackReg(addr_port.first, addr_port.second);
-		device->setRegChangedCallback([this](const std::string& serial, uint8_t addr, uint8_t port, uint16_t value) {
-			// TODO: post callback to asio loop?
-			if (m_device_reg_change_cb) m_device_reg_change_cb(serial, addr, port, value);
+		// program the device in the background, so several devices are brought up in parallel,
+		// it is added to the manager and reported to clients once ready
+		m_pending_map.insert(std::make_pair(dev, device));
+		m_programming.insert(serial);
+		// descriptions are not modified after construction and can be referenced from workers
+		const device_description_t& description = *desc;
+		auto t_start = std::chrono::steady_clock::now();
+		unsigned int calibrated_hz = _calibratedClock(serial);
+		m_programmers.run([this, device, &description, calibrated_hz]() {
+			_programDevice(device, description, false, calibrated_hz);
+		}, [this, dev, device, t_start](std::exception_ptr error) {
+			m_programming.erase(device->name());
+			// the device may have been unplugged in the meantime
+			auto it = m_pending_map.find(dev);
+			if (it == m_pending_map.end() || it->second != device)
+				return;
+			m_pending_map.erase(it);
+			try {
+				if (error) std::rethrow_exception(error);
+				std::cout << "Ready " << device->name() << " after " <<
+						std::chrono::duration_cast<std::chrono::milliseconds>(
+						std::chrono::steady_clock::now() - t_start).count() << " ms" << std::endl;
+				_addDevice(device);
+			} catch (const std::exception& e) {
+				std::cerr << "Adding device failed: " << e.what() << std::endl;
+			}
 		});
 
 	} catch (const std::exception& e) {
@@ -149,7 +176,28 @@ void DeviceManager::_usbDeviceAdded(libusb_device* dev) {
 	}
 }
 
+void DeviceManager::_addDevice(ptrDevice_t device) {
+	auto desc = find_description(device->name(), m_device_descriptions);
+
+	// add new device to manager
+	m_device_map.insert(std::make_pair(device->libusbDevice(), device));
+	m_serial_map.insert(std::make_pair(device->name(), device));
+
+	// emit added callback
+	if (m_device_added_cb) m_device_added_cb(device->name());  // TODO: post callback to asio loop?
+
+	// setup register tracking information and set callback
+	for (auto& addr_port: desc->watchlist)
+		device->trackReg(addr_port.first, addr_port.second);
+	device->setRegChangedCallback([this](const std::string& serial, uint8_t addr, uint8_t port, uint16_t value) {
+		// TODO: post callback to asio loop?
+		if (m_device_reg_change_cb) m_device_reg_change_cb(serial, addr, port, value);
+	});
+}
+
 void DeviceManager::_usbDeviceRemoved(libusb_device* dev) {
+	// devices still being brought up are dropped once programming finished
+	m_pending_map.erase(dev);
 	if (hasDevice(dev)) {
 		const std::string& serial = m_device_map[dev]->name();
 		_removeDevice(serial);
@@ -174,6 +222,7 @@ void DeviceManager::_periodicRegisterUpdates() {
 	// poll tracked registers for all devices and emit callbacks
 	for (auto p = m_serial_map.begin(); p != m_serial_map.end();) {
 		auto device = (p++)->second;
+		if (isProgramming(device->name())) continue;
 		try {
 			device->updateTrackedRegs();
 		} catch (std::exception& e) {
@@ -191,11 +240,11 @@ void DeviceManager::_periodicRegisterUpdates() {
 	});
 }
 
-bool DeviceManager::reprogramDevice(const std::string& serial) {
-	return reprogramDevice(getDevice(serial));
+bool DeviceManager::reprogramDevice(const std::string& serial, fn_device_programmed_cb done) {
+	return reprogramDevice(getDevice(serial), std::move(done));
 }
 
-bool DeviceManager::reprogramDevice(ptrDevice_t device) {
+bool DeviceManager::reprogramDevice(ptrDevice_t device, fn_device_programmed_cb done) {
 	// check for device, description, and bitfile definition
 	if (!device)
 		return false;
@@ -204,26 +253,117 @@ bool DeviceManager::reprogramDevice(ptrDevice_t device) {
 		return false;
 	if (desc->fname_bitfile.empty())
 		return false;
-	std::cout << "Programming " << device->name() << ": " << desc->fname_bitfile << std::endl;
+	if (isProgramming(device->name()))
+		throw std::runtime_error("Device busy");
+
+	// program on a worker thread, the device is skipped by register updates until finished
+	std::string serial = device->name();
+	const device_description_t& description = *desc;
+	m_programming.insert(serial);
+	unsigned int calibrated_hz = _calibratedClock(serial);
+	m_programmers.run([this, device, &description, calibrated_hz]() {
+		_programDevice(device, description, true, calibrated_hz);
+	}, [this, serial, done](std::exception_ptr error) {
+		m_programming.erase(serial);
+		if (done) done(error);
+	});
+	return true;
+}
+
+bool DeviceManager::isProgramming(const std::string& serial) {
+	return m_programming.find(serial) != m_programming.end();
+}
+
+unsigned int DeviceManager::_calibratedClock(const std::string& serial) {
+	auto it = m_jtag_clocks.find(serial);
+	return it != m_jtag_clocks.end() ? it->second : 0;
+}
+
+void DeviceManager::_programDevice(ptrDevice_t device, const device_description_t& desc, bool force,
+		unsigned int calibrated_hz) {
+	// may run on any thread, progress is reported on the event loop
+	std::string serial = device->name();
+	auto t_start = std::chrono::steady_clock::now();
+	fn_programmer_progress_cb progress = [this, serial, t_start](const std::string& phase,
+			size_t bytes_done, size_t bytes_total) {
+		uint64_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - t_start).count();
+		m_io_service.post([this, serial, phase, bytes_done, bytes_total, elapsed_ms]() {
+			if (m_device_programming_cb) m_device_programming_cb(serial, phase, bytes_done, bytes_total, elapsed_ms);
+		});
+	};
+	std::cout << "Programming " << serial << ": " << desc.fname_bitfile << std::endl;
+
+	// get the parsed bitstream before touching the device
+	progress("load", 0, 0);
+	ptrBitstream_t bitstream;
+	try {
+		bitstream = m_bitstreams.get(desc.fname_bitfile);
+	} catch (...) {
+		progress("failed", 0, 0);
+		throw;
+	}
+
+	// a rate found by an earlier calibration is used until programming fails with it
+	programmer_options_t options = m_programmer_options;
+	options.jtag_clock_hz = calibrated_hz ? calibrated_hz : desc.jtag_clock_hz;
+	options.calibrate_clock = m_programmer_options.calibrate_clock && !calibrated_hz;
+
+	// the configured usercode overrides the UserID of the bitfile
+	bool has_usercode = desc.has_usercode || bitstream->has_usercode;
+	uint32_t usercode = desc.has_usercode ? desc.usercode : bitstream->usercode;
 
 	// release the usb device and reprogram before claiming it again
 	libusb_device* dev = device->libusbDevice();
 	device->close();
+	bool skipped = false;
 	try {
-		DeviceProgrammer programmer(dev);
-		programmer.program(desc->fname_bitfile);
+		progress("connect", 0, 0);
+		DeviceProgrammer programmer(m_libusb_service.context(), dev, options);
+		if (options.calibrate_clock) {
+			progress("calibrate", 0, 0);
+			unsigned int hz = programmer.calibrateClock(desc.jtag_clock_hz);
+			std::cout << "Calibrated Jtag clock of " << serial << " to " << hz << " Hz" << std::endl;
+			m_io_service.post([this, serial, hz]() {
+				m_jtag_clocks[serial] = hz;
+			});
+		}
+		// a device that kept its configuration is left running unless forced
+		if (!force && has_usercode && programmer.isConfigured()
+				&& programmer.readUsercode() == usercode) {
+			skipped = true;
+		} else {
+			programmer.program(*bitstream, progress);
+		}
 	} catch (...) {
-		device->open();
+		progress("failed", 0, 0);
+		if (m_programmer_options.calibrate_clock) {
+			m_io_service.post([this, serial]() {
+				m_jtag_clocks.erase(serial);
+			});
+		}
+		// report the programming error, not a failure to reopen the device
+		try {
+			device->open();
+		} catch (const std::exception& e) {
+			std::cerr << "Reopening " << serial << " failed: " << e.what() << std::endl;
+		}
 		throw;
 	}
-	std::cout << "Finished programming " << device->name() << std::endl;
+	if (skipped) {
+		std::cout << "Skipped programming " << serial << ", USERCODE matches" << std::endl;
+	} else {
+		std::cout << "Finished programming " << serial << std::endl;
+	}
 
 	device->open();
-	return true;
+	progress(skipped ? "skipped" : "done", 0, 0);
 }
 
 void DeviceManager::stop() {
 	m_timer.cancel();
+	// programming runs are not interrupted, wait for them to finish
+	m_programmers.stop();
 }
 
 bool DeviceManager::hasDevice(libusb_device* dev) {
@@ -236,6 +376,13 @@ void DeviceManager::getDeviceList(std::list<std::string>& list) {
 	}
 }
 
+void DeviceManager::getDevicesByPrefix(const std::string& prefix, std::list<ptrDevice_t>& devices) {
+	for (auto& elem: m_serial_map) {
+		if (boost::algorithm::starts_with(elem.first, prefix))
+			devices.push_back(elem.second);
+	}
+}
+
 ptrDevice_t DeviceManager::getDevice(const std::string& serial) {
 	if (hasSerial(serial)) {
 		return m_serial_map[serial]->shared_from_this();
@@ -259,3 +406,7 @@ void DeviceManager::setRemovedCallback(fn_device_removed_cb cb) {
 void DeviceManager::setRegChangedCallback(fn_device_reg_changed_cb cb) {
 	m_device_reg_change_cb = std::move(cb);
 }
+
+void DeviceManager::setProgrammingCallback(fn_device_programming_cb cb) {
+	m_device_programming_cb = std::move(cb);
+}
@@ -9,15 +9,24 @@
 #define DEVICES_DEVICEMANAGER_H_
 
 #include <list>
+#include <set>
 #include <boost/asio/steady_timer.hpp>
 
 #include "../libusb_asio/libusb_service.h"
+#include "../WorkerPool.h"
+#include "../cache/BitstreamCache.h"
 #include "Device.h"
+#include "DeviceProgrammer.h"
 
 typedef std::function<void(const std::string&)> fn_device_added_cb;
 typedef std::function<void(const std::string&)> fn_device_removed_cb;
+// serial, phase, bytes shifted, total bytes and milliseconds since programming started
+typedef std::function<void(const std::string&, const std::string&, size_t, size_t, uint64_t)> fn_device_programming_cb;
+typedef std::function<void(std::exception_ptr)> fn_device_programmed_cb;
 
 #define DEVICE_MANAGER_UPDATE_DELAY_MS 500
+// default number of devices that can be programmed at the same time
+#define DEVICE_MANAGER_PROGRAMMING_THREADS 4
 
 void getUsbDeviceStrings(libusb_device* dev,
 		std::string& manufacturer, std::string& product, std::string& serial);
@@ -28,7 +37,14 @@ public:
 		std::string name;
 		std::string serial_prefix;
 		std::string fname_bitfile;
+		// overrides the UserID of the bitfile header when deciding whether the
+		// configured device has to be programmed at bring-up
+		bool has_usercode;
+		uint32_t usercode;
+		// TCK while programming, 0 for the fastest rate, upper limit of the calibration
+		unsigned int jtag_clock_hz;
 		std::list<Device::addr_port_t> watchlist;
+		std::list<Device::shadow_config_t> shadows;
 	};
 	typedef std::list<device_description_t> device_descriptions_t;
 
@@ -36,14 +52,21 @@ public:
 	DeviceManager& operator=(const DeviceManager&) = delete;
 	DeviceManager(boost::asio::io_service& io_service,
 			boost::asio::libusb_service& usb_service,
-			device_descriptions_t device_descriptions);
+			device_descriptions_t device_descriptions,
+			BitstreamCache& bitstreams,
+			size_t programming_threads = DEVICE_MANAGER_PROGRAMMING_THREADS,
+			const programmer_options_t& programmer_options = programmer_options_t());
 	virtual ~DeviceManager();
 	void stop();
 
 	void getDeviceList(std::list<std::string>& list);
 	ptrDevice_t getDevice(const std::string& serial);
-	bool reprogramDevice(const std::string& serial);
-	bool reprogramDevice(ptrDevice_t device);
+	void getDevicesByPrefix(const std::string& prefix, std::list<ptrDevice_t>& devices);
+	// programs the device in the background, returns false if it has no bitfile defined,
+	// otherwise the callback is invoked on the event loop when finished
+	bool reprogramDevice(const std::string& serial, fn_device_programmed_cb done);
+	bool reprogramDevice(ptrDevice_t device, fn_device_programmed_cb done);
+	bool isProgramming(const std::string& serial);
 
 	bool hasDevice(libusb_device*);
 	bool hasSerial(const std::string& serial);
@@ -51,6 +74,7 @@ public:
 	void setAddedCallback(fn_device_added_cb cb);
 	void setRemovedCallback(fn_device_removed_cb cb);
 	void setRegChangedCallback(fn_device_reg_changed_cb cb);
+	void setProgrammingCallback(fn_device_programming_cb cb);
 
 private:
 	boost::asio::io_service& m_io_service;
@@ -62,8 +86,20 @@ private:
 	fn_device_added_cb m_device_added_cb;
 	fn_device_removed_cb m_device_removed_cb;
 	fn_device_reg_changed_cb m_device_reg_change_cb;
+	fn_device_programming_cb m_device_programming_cb;
+	BitstreamCache& m_bitstreams;
+	WorkerPool m_programmers;
+	programmer_options_t m_programmer_options;
+	// calibrated JTAG clock by serial, only accessed on the event loop
+	std::map<std::string, unsigned int> m_jtag_clocks;
+	std::set<std::string> m_programming;
+	std::map<libusb_device*, ptrDevice_t> m_pending_map;
 
 	void _usbDeviceAdded(libusb_device*);
+	void _addDevice(ptrDevice_t device);
+	void _programDevice(ptrDevice_t device, const device_description_t& desc, bool force,
+			unsigned int calibrated_hz);
+	unsigned int _calibratedClock(const std::string& serial);
 	void _usbDeviceRemoved(libusb_device*);
 	void _removeDevice(const std::string& serial);
 	void _periodicRegisterUpdates();
@@ -6,21 +6,43 @@
 //-----------------------------------------------------------------------------
 
 #include "DeviceProgrammer.h"
-#include "xc3sprog/bitfile.h"
 #include "xc3sprog/progalgxc3s.h"
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <vector>
 
 const int XC6_XC7_IRLEN = 6;
+static const byte XC6_XC7_USERCODE[1] = {0x08};
+static const byte XC6_XC7_BYPASS[1] = {0x3f};
+static const byte XC6_XC7_IDCODE[1] = {0x09};
+// calibration steps, 30 MHz divided by 30, 15, 10, 6, 5, 4, 3, 2 and 1
+static const unsigned int CALIBRATION_CLOCKS_HZ[] = {
+	1000000, 2000000, 3000000, 5000000, 6000000, 7500000, 10000000, 15000000, 30000000
+};
 
-DeviceProgrammer::DeviceProgrammer(libusb_device* dev) : m_ioftdi(dev, INTERFACE_B), m_jtag(&m_ioftdi) {
+// calibration starts at the slowest step, or at the clock limit if that is lower
+static unsigned int initialClockHz(const programmer_options_t& options) {
+	if (!options.calibrate_clock)
+		return options.jtag_clock_hz;
+	if (options.jtag_clock_hz)
+		return std::min(CALIBRATION_CLOCKS_HZ[0], options.jtag_clock_hz);
+	return CALIBRATION_CLOCKS_HZ[0];
+}
+
+DeviceProgrammer::DeviceProgrammer(libusb_context* ctx, libusb_device* dev,
+		const programmer_options_t& options) :
+		m_ioftdi(ctx, dev, INTERFACE_B, initialClockHz(options),
+				options.transfer_bytes, options.transfer_queue),
+		m_jtag(&m_ioftdi) {
 	// check jtag chain
 	int n = m_jtag.getChain();
 	if (n != 1)
 		throw std::runtime_error("Error in Jtag chain");
         auto idcode = m_jtag.getDeviceID(0);
+	m_idcode = idcode;
 
 	if (idcode == 0x24001093) {
             // Spartan6 LX9
@@ -40,16 +62,78 @@ DeviceProgrammer::DeviceProgrammer(libusb_device* dev) : m_ioftdi(dev, INTERFACE
 DeviceProgrammer::~DeviceProgrammer() {
 }
 
-void DeviceProgrammer::program(const std::string& fname_bitfile) {
-	// open bitfile and read data for programming
-	BitFile bitfile;
-	FILE* fh = fopen(fname_bitfile.c_str(), "rb");
-	if (!fh)
-		throw std::runtime_error("Could not open bitfile");
-	if (bitfile.readFile(fh, STYLE_BIT) != 0)
-		throw std::runtime_error("Error processing bitfile");
-
-	// setup program algorithm and start programming
+void DeviceProgrammer::program(bitstream_t& bitstream, fn_programmer_progress_cb progress_cb) {
+	// setup program algorithm and start programming, the chain holds a single device
+	// so the precompiled command streams of the bitstream apply
+	BitFile& bitfile = bitstream.bitfile;
 	ProgAlgXC3S progalg(m_jtag, m_family);
+	progalg.setSliceStreams(&bitstream.slice_streams);
+	if (progress_cb) {
+		progress_cb("shift", 0, bitfile.getLength() / 8);
+		progalg.setProgressCallback([&progress_cb](unsigned int bits_done, unsigned int bits_total) {
+			// the device starts up once all configuration data is shifted in
+			progress_cb(bits_done == bits_total ? "startup" : "shift", bits_done / 8, bits_total / 8);
+		});
+	}
 	progalg.array_program(bitfile);
 }
+
+bool DeviceProgrammer::isConfigured() {
+	// instruction capture reads xx1xxx01 once the device is configured
+	byte capture[1] = {0};
+	m_jtag.shiftIR(XC6_XC7_BYPASS, capture);
+	return (capture[0] & 0x23) == 0x21;
+}
+
+uint32_t DeviceProgrammer::readUsercode() {
+	byte data[4] = {0};
+	m_jtag.shiftIR(XC6_XC7_USERCODE);
+	m_jtag.shiftDR(nullptr, data, 32);
+	m_jtag.shiftIR(XC6_XC7_BYPASS);
+	return m_jtag.byteArrayToLong(data);
+}
+
+uint32_t DeviceProgrammer::_readIdcode() {
+	byte data[4] = {0};
+	m_jtag.shiftIR(XC6_XC7_IDCODE);
+	m_jtag.shiftDR(nullptr, data, 32);
+	return m_jtag.byteArrayToLong(data);
+}
+
+unsigned int DeviceProgrammer::calibrateClock(unsigned int max_hz) {
+	// a limit below the slowest step is the only rate that is checked
+	std::vector<unsigned int> steps;
+	for (unsigned int hz: CALIBRATION_CLOCKS_HZ) {
+		if (!max_hz || hz <= max_hz)
+			steps.push_back(hz);
+	}
+	if (steps.empty())
+		steps.push_back(max_hz);
+
+	unsigned int stable_hz = 0;
+	for (unsigned int hz: steps) {
+		unsigned int set_hz = m_ioftdi.setFrequency(hz);
+		if (set_hz <= stable_hz)
+			continue;
+		bool ok = true;
+		try {
+			for (int i = 0; ok && i < DEVICE_PROGRAMMER_CALIBRATION_READS; i++)
+				ok = (_readIdcode() == m_idcode);
+		} catch (const std::exception&) {
+			ok = false;
+		}
+		if (!ok)
+			break;
+		stable_hz = set_hz;
+	}
+	if (!stable_hz)
+		throw std::runtime_error("No stable Jtag clock found");
+
+	// go back to the fastest stable rate and make sure the TAP is in a known state
+	m_ioftdi.setFrequency(stable_hz);
+	m_jtag.tapTestLogicReset();
+	if (_readIdcode() != m_idcode)
+		throw std::runtime_error("Jtag clock calibration failed");
+	m_jtag.shiftIR(XC6_XC7_BYPASS);
+	return stable_hz;
+}
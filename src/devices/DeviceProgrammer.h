@@ -11,19 +11,49 @@
 #include <libusb.h>
 #include "xc3sprog/ioftdi.h"
 #include "xc3sprog/jtag.h"
+#include "../cache/BitstreamCache.h"
+#include <functional>
 #include <string>
 
+// progress of a programming run as phase, bytes shifted and total bytes of the bitstream
+typedef std::function<void(const std::string&, size_t, size_t)> fn_programmer_progress_cb;
+
+// IDCODE reads at each step of the clock calibration
+#define DEVICE_PROGRAMMER_CALIBRATION_READS 32
+
+// asynchronous USB transfers used for shifting data into the device and the JTAG clock
+struct programmer_options_t {
+	unsigned int transfer_bytes = TX_CHUNK_DEFAULT;
+	unsigned int transfer_queue = TX_QUEUE_DEFAULT;
+	// TCK in Hz, 0 selects the fastest rate of the interface
+	unsigned int jtag_clock_hz = 0;
+	// find the fastest stable clock before programming, see calibrateClock()
+	bool calibrate_clock = false;
+};
+
 class DeviceProgrammer {
 public:
-	DeviceProgrammer(libusb_device* dev);
+	DeviceProgrammer(libusb_context* ctx, libusb_device* dev,
+			const programmer_options_t& options = programmer_options_t());
 	virtual ~DeviceProgrammer();
 
-	void program(const std::string& fname_bitfile);
+	void program(bitstream_t& bitstream, fn_programmer_progress_cb progress_cb = nullptr);
+	// true if the FPGA has completed configuration (DONE is high)
+	bool isConfigured();
+	// USERCODE of the loaded configuration, as set with bitgen -g UserID
+	uint32_t readUsercode();
+	// steps up the clock up to max_hz (0 for no limit) as long as the IDCODE reads back
+	// correctly, sets and returns the fastest stable rate. A max_hz below the slowest
+	// step is checked on its own.
+	unsigned int calibrateClock(unsigned int max_hz = 0);
 
 private:
 	IOFtdi m_ioftdi;
 	Jtag m_jtag;
         int m_family;
+	uint32_t m_idcode;
+
+	uint32_t _readIdcode();
 };
 
 #endif /* SRC_DEVICES_DEVICEPROGRAMMER_H_ */
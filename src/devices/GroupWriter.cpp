@@ -0,0 +1,81 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "GroupWriter.h"
+#include <algorithm>
+#include <atomic>
+
+GroupWriter::GroupWriter(boost::asio::io_service& io_service) :
+	m_io_service(io_service),
+	m_lanes()
+{
+}
+
+GroupWriter::~GroupWriter() {
+	stop();
+}
+
+void GroupWriter::stop() {
+	// finish pending writes and join lane threads
+	for (auto& lane: m_lanes) {
+		lane->work.reset();
+		if (lane->thread.joinable()) lane->thread.join();
+	}
+	m_lanes.clear();
+}
+
+void GroupWriter::addLanes(size_t n) {
+	// lanes are created on demand and kept for later writes
+	n = std::min(n, size_t(GROUP_WRITE_MAX_LANES));
+	while (m_lanes.size() < n) {
+		std::unique_ptr<lane_t> lane(new lane_t());
+		lane->work.reset(new boost::asio::io_service::work(lane->service));
+		lane_t* p = lane.get();
+		lane->thread = std::thread([p]() {
+			p->service.run();
+		});
+		m_lanes.push_back(std::move(lane));
+	}
+}
+
+void GroupWriter::write(const std::vector<ptrDevice_t>& devices, uint8_t addr, uint8_t port,
+		uint16_t value, fn_done_cb cb)
+{
+	auto results = std::make_shared<std::vector<result_t>>(devices.size());
+	if (devices.empty()) {
+		m_io_service.post([results, cb]() {
+			cb(*results);
+		});
+		return;
+	}
+	addLanes(devices.size());
+
+	auto n_pending = std::make_shared<std::atomic<size_t>>(devices.size());
+	auto t_start = clock_t::now() + std::chrono::microseconds(GROUP_WRITE_START_DELAY_US);
+	for (size_t i = 0; i < devices.size(); ++i) {
+		ptrDevice_t device = devices[i];
+		(*results)[i].serial = device->name();
+		m_lanes[i % m_lanes.size()]->service.post([this, device, addr, port, value, t_start, i, results, n_pending, cb]() {
+			result_t& result = (*results)[i];
+			while (clock_t::now() < t_start) {}
+			auto t0 = clock_t::now();
+			try {
+				device->writeReg(addr, port, value);
+			} catch (const std::exception& e) {
+				result.error = e.what();
+			}
+			auto t1 = clock_t::now();
+			result.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t0 - t_start).count();
+			result.done_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t_start).count();
+			if (--(*n_pending) == 0) {
+				m_io_service.post([results, cb]() {
+					cb(*results);
+				});
+			}
+		});
+	}
+}
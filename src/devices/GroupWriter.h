@@ -0,0 +1,58 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef DEVICES_GROUPWRITER_H_
+#define DEVICES_GROUPWRITER_H_
+
+#include <thread>
+#include <boost/asio.hpp>
+
+#include "Device.h"
+
+// maximum number of threads issuing writes in parallel, further devices share threads
+#define GROUP_WRITE_MAX_LANES 64
+// delay of the common start time, allows all threads to pick up their write
+#define GROUP_WRITE_START_DELAY_US 500
+
+// Writes a register on several devices at the same time. Each device is
+// written from its own thread ("lane"), all lanes start at a common time.
+// Completion handlers are invoked on the thread running the main io_service.
+class GroupWriter {
+public:
+	typedef std::chrono::steady_clock clock_t;
+
+	struct result_t {
+		std::string serial;
+		int64_t start_ns;  // start of the write relative to the common start time
+		int64_t done_ns;  // completion of the write relative to the common start time
+		std::string error;
+	};
+	typedef std::function<void(const std::vector<result_t>&)> fn_done_cb;
+
+	GroupWriter(const GroupWriter&) = delete;
+	GroupWriter& operator=(const GroupWriter&) = delete;
+	explicit GroupWriter(boost::asio::io_service& io_service);
+	virtual ~GroupWriter();
+	void stop();
+
+	void write(const std::vector<ptrDevice_t>& devices, uint8_t addr, uint8_t port,
+			uint16_t value, fn_done_cb cb);
+
+private:
+	struct lane_t {
+		boost::asio::io_service service;
+		std::unique_ptr<boost::asio::io_service::work> work;
+		std::thread thread;
+	};
+
+	void addLanes(size_t n);
+
+	boost::asio::io_service& m_io_service;
+	std::vector<std::unique_ptr<lane_t>> m_lanes;
+};
+
+#endif /* DEVICES_GROUPWRITER_H_ */
@@ -0,0 +1,156 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "RegisterHistory.h"
+#include <algorithm>
+#include <stdexcept>
+
+// maximum encoded size of an entry, 10 bytes time delta and 3 bytes value delta
+#define ENTRY_MAX_BYTES 13
+
+static size_t encodeVarint(uint64_t v, uint8_t* out) {
+	size_t n = 0;
+	while (v >= 0x80) {
+		out[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	out[n++] = v;
+	return n;
+}
+
+RegisterHistory::RegisterHistory(size_t n_bytes) :
+	m_ring(n_bytes),
+	m_head(0),
+	m_used(0),
+	m_count(0),
+	m_first(),
+	m_last()
+{
+	if (n_bytes < ENTRY_MAX_BYTES) throw std::invalid_argument("Register history too small");
+}
+
+size_t RegisterHistory::size() const {
+	return m_count;
+}
+
+uint8_t RegisterHistory::at(size_t pos) const {
+	return m_ring[pos % m_ring.size()];
+}
+
+size_t RegisterHistory::decodeDelta(size_t pos, uint64_t& dt, int32_t& dv) const {
+	// returns the encoded size of the delta at ring position pos
+	size_t n = 0;
+	uint64_t v = 0;
+	for (int shift = 0; ; shift += 7) {
+		uint8_t b = at(pos + n++);
+		v |= uint64_t(b & 0x7f) << shift;
+		if (!(b & 0x80)) break;
+	}
+	dt = v;
+	v = 0;
+	for (int shift = 0; ; shift += 7) {
+		uint8_t b = at(pos + n++);
+		v |= uint64_t(b & 0x7f) << shift;
+		if (!(b & 0x80)) break;
+	}
+	dv = int32_t(v >> 1) ^ -int32_t(v & 1);
+	return n;
+}
+
+void RegisterHistory::push(const uint8_t* data, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		m_ring[m_head] = data[i];
+		m_head = (m_head + 1) % m_ring.size();
+	}
+	m_used += n;
+}
+
+void RegisterHistory::dropOldest() {
+	// the second entry becomes the new absolute oldest entry
+	size_t tail = (m_head + m_ring.size() - m_used) % m_ring.size();
+	uint64_t dt;
+	int32_t dv;
+	size_t n = decodeDelta(tail, dt, dv);
+	m_first.first += dt;
+	m_first.second += dv;
+	m_used -= n;
+	m_count--;
+}
+
+void RegisterHistory::record(uint64_t t_ms, uint16_t value) {
+	if (m_count == 0) {
+		m_first = m_last = entry_t(t_ms, value);
+		m_count = 1;
+		return;
+	}
+	if (value == m_last.second) return;
+
+	// clocks are not guaranteed to be monotonic, keep deltas non-negative
+	if (t_ms < m_last.first) t_ms = m_last.first;
+	uint8_t buffer[ENTRY_MAX_BYTES];
+	int32_t dv = int32_t(value) - int32_t(m_last.second);
+	size_t n = encodeVarint(t_ms - m_last.first, buffer);
+	n += encodeVarint(uint32_t((dv << 1) ^ (dv >> 31)), buffer + n);
+
+	while (m_ring.size() - m_used < n) {
+		dropOldest();
+	}
+	push(buffer, n);
+	m_last = entry_t(t_ms, value);
+	m_count++;
+}
+
+void RegisterHistory::query(uint64_t t_from, uint64_t t_to, size_t max_points,
+		std::vector<entry_t>& entries) const
+{
+	entries.clear();
+	if (m_count == 0 || t_from > t_to) return;
+
+	// decode entries in range, starting with the value held at t_from
+	std::vector<entry_t> all;
+	entry_t entry = m_first;
+	size_t pos = (m_head + m_ring.size() - m_used) % m_ring.size();
+	for (size_t i = 0; i < m_count; ++i) {
+		if (i > 0) {
+			uint64_t dt;
+			int32_t dv;
+			pos += decodeDelta(pos, dt, dv);
+			entry.first += dt;
+			entry.second += dv;
+		}
+		if (entry.first > t_to) break;
+		if (entry.first < t_from) {
+			if (all.empty()) all.push_back(entry);
+			else all.back() = entry;
+		} else {
+			all.push_back(entry);
+		}
+	}
+
+	if (max_points == 0 || all.size() <= max_points) {
+		entries = std::move(all);
+		return;
+	}
+
+	// keep the entries with minimum and maximum value of each time bucket
+	size_t n_buckets = std::max(max_points / 2, size_t(1));
+	uint64_t t_begin = all.front().first;
+	uint64_t t_span = all.back().first - t_begin + 1;
+	size_t i = 0;
+	while (i < all.size()) {
+		uint64_t bucket = (all[i].first - t_begin) * n_buckets / t_span;
+		size_t i_min = i, i_max = i;
+		size_t j = i + 1;
+		for (; j < all.size() && (all[j].first - t_begin) * n_buckets / t_span == bucket; ++j) {
+			if (all[j].second < all[i_min].second) i_min = j;
+			if (all[j].second > all[i_max].second) i_max = j;
+		}
+		entries.push_back(all[std::min(i_min, i_max)]);
+		if (i_min != i_max) entries.push_back(all[std::max(i_min, i_max)]);
+		i = j;
+	}
+}
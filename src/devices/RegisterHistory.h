@@ -0,0 +1,51 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef DEVICES_REGISTERHISTORY_H_
+#define DEVICES_REGISTERHISTORY_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// default size of the history ring of each tracked register
+#define REGISTER_HISTORY_BYTES (16*1024)
+
+// History of register value changes in a fixed-size ring of bytes. The oldest
+// entry is kept as absolute (time, value), all following entries as varint
+// encoded time delta and zigzag encoded value delta to their predecessor.
+// Oldest entries are dropped when the ring is full.
+class RegisterHistory {
+public:
+	typedef std::pair<uint64_t, uint16_t> entry_t;
+
+	explicit RegisterHistory(size_t n_bytes = REGISTER_HISTORY_BYTES);
+
+	// record value at time t_ms, only changes of the value are stored
+	void record(uint64_t t_ms, uint16_t value);
+
+	// entries in [t_from, t_to] preceded by the last entry before t_from, reduced
+	// to the entries holding the minimum and maximum of max_points/2 time buckets
+	void query(uint64_t t_from, uint64_t t_to, size_t max_points,
+			std::vector<entry_t>& entries) const;
+	size_t size() const;
+
+private:
+	void push(const uint8_t* data, size_t n);
+	void dropOldest();
+	size_t decodeDelta(size_t pos, uint64_t& dt, int32_t& dv) const;
+	uint8_t at(size_t pos) const;
+
+	std::vector<uint8_t> m_ring;
+	size_t m_head;  // position of the next byte to write
+	size_t m_used;  // number of bytes of deltas in the ring
+	size_t m_count;  // number of entries including the oldest one
+	entry_t m_first;  // oldest entry
+	entry_t m_last;  // newest entry
+};
+
+#endif /* DEVICES_REGISTERHISTORY_H_ */
@@ -0,0 +1,244 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "Sequencer.h"
+#include <set>
+#include <stdexcept>
+
+// encoded length of an instruction including the opcode, 0 for invalid opcodes
+static size_t instructionLength(uint8_t op) {
+	switch (op) {
+	case SEQ_OP_END: return 1;
+	case SEQ_OP_WRITE: return 5;
+	case SEQ_OP_WRITE_R: return 4;
+	case SEQ_OP_READ: return 4;
+	case SEQ_OP_WAIT: return 11;
+	case SEQ_OP_SLEEP: return 5;
+	case SEQ_OP_SET: return 4;
+	case SEQ_OP_ADD: return 4;
+	case SEQ_OP_AND: return 4;
+	case SEQ_OP_BRANCH: return 7;
+	case SEQ_OP_JUMP: return 3;
+	case SEQ_OP_LOOP: return 4;
+	case SEQ_OP_EMIT: return 2;
+	case SEQ_OP_READN: return 5;
+	default: return 0;
+	}
+}
+
+static uint16_t be16(const std::vector<uint8_t>& p, size_t offset) {
+	return (p[offset] << 8) | p[offset+1];
+}
+
+void validateSequencerProgram(const std::vector<uint8_t>& program) {
+	if (program.empty() || program.size() > SEQ_PROGRAM_MAX_BYTES) {
+		throw std::invalid_argument("Invalid program size");
+	}
+
+	// decode all instructions and collect jump targets
+	std::set<size_t> boundaries, targets;
+	size_t pc = 0;
+	uint8_t op = SEQ_OP_END;
+	while (pc < program.size()) {
+		op = program[pc];
+		size_t len = instructionLength(op);
+		if (len == 0) throw std::invalid_argument("Invalid opcode at " + std::to_string(pc));
+		if (pc + len > program.size()) throw std::invalid_argument("Truncated instruction at " + std::to_string(pc));
+
+		uint8_t reg = 0;
+		switch (op) {
+		case SEQ_OP_WRITE_R:
+		case SEQ_OP_READ:
+			reg = program[pc+3];
+			break;
+		case SEQ_OP_SET:
+		case SEQ_OP_ADD:
+		case SEQ_OP_AND:
+		case SEQ_OP_EMIT:
+			reg = program[pc+1];
+			break;
+		case SEQ_OP_BRANCH:
+			reg = program[pc+1];
+			if (program[pc+2] > SEQ_COND_ANY) throw std::invalid_argument("Invalid condition at " + std::to_string(pc));
+			targets.insert(be16(program, pc+5));
+			break;
+		case SEQ_OP_JUMP:
+			targets.insert(be16(program, pc+1));
+			break;
+		case SEQ_OP_LOOP:
+			reg = program[pc+1];
+			targets.insert(be16(program, pc+2));
+			break;
+		}
+		if (reg >= SEQ_N_REGS) throw std::invalid_argument("Invalid register at " + std::to_string(pc));
+		boundaries.insert(pc);
+		pc += len;
+	}
+	if (op != SEQ_OP_END) throw std::invalid_argument("Program does not end with END");
+	for (size_t target: targets) {
+		if (boundaries.find(target) == boundaries.end()) {
+			throw std::invalid_argument("Invalid jump target " + std::to_string(target));
+		}
+	}
+}
+
+SequencerRun::SequencerRun(boost::asio::io_service& io_service, ptrDevice_t device,
+		ptrSequencerProgram_t program, uint64_t max_steps, fn_done_cb cb) :
+	m_timer(io_service),
+	m_device(std::move(device)),
+	m_program(std::move(program)),
+	m_max_steps(max_steps),
+	m_done_cb(std::move(cb)),
+	m_pc(0),
+	m_steps(0),
+	m_regs(),
+	m_results(),
+	m_waiting(false),
+	m_wait_deadline()
+{
+}
+
+void SequencerRun::start() {
+	run();
+}
+
+void SequencerRun::cancel() {
+	m_timer.cancel();
+	finish(std::make_exception_ptr(std::runtime_error("Run cancelled")));
+}
+
+uint8_t SequencerRun::u8(size_t offset) const {
+	return (*m_program)[m_pc + offset];
+}
+
+uint16_t SequencerRun::u16(size_t offset) const {
+	return be16(*m_program, m_pc + offset);
+}
+
+uint32_t SequencerRun::u32(size_t offset) const {
+	return (uint32_t(u16(offset)) << 16) | u16(offset + 2);
+}
+
+void SequencerRun::run() {
+	// a finished or cancelled run may still have a timer handler queued
+	if (!m_done_cb) return;
+	try {
+		// execute a slice of instructions, then let other handlers run
+		for (int i = 0; i < SEQ_SLICE_STEPS; ++i) {
+			if (!step()) return;
+		}
+	} catch (...) {
+		finish(std::current_exception());
+		return;
+	}
+	continueAfter(std::chrono::microseconds(0));
+}
+
+void SequencerRun::continueAfter(std::chrono::microseconds delay) {
+	auto self(shared_from_this());
+	m_timer.expires_from_now(delay);
+	m_timer.async_wait([this, self](const boost::system::error_code& ec) {
+		if (!ec) run();
+	});
+}
+
+bool SequencerRun::step() {
+	// returns false if execution finished or continues asynchronously
+	if (!m_device->isOpen()) throw std::runtime_error("Device closed");
+	if (++m_steps > m_max_steps) throw std::runtime_error("Step limit exceeded");
+
+	uint8_t op = u8(0);
+	size_t next = m_pc + instructionLength(op);
+	switch (op) {
+	case SEQ_OP_END:
+		finish(nullptr);
+		return false;
+	case SEQ_OP_WRITE:
+		m_device->writeReg(u8(1), u8(2), u16(3));
+		break;
+	case SEQ_OP_WRITE_R:
+		m_device->writeReg(u8(1), u8(2), m_regs[u8(3)]);
+		break;
+	case SEQ_OP_READ:
+		m_device->readReg(u8(1), u8(2), &m_regs[u8(3)]);
+		break;
+	case SEQ_OP_WAIT: {
+		if (!m_waiting) {
+			m_waiting = true;
+			m_wait_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(u32(7));
+		}
+		uint16_t value;
+		m_device->readReg(u8(1), u8(2), &value);
+		if ((value & u16(3)) != u16(5)) {
+			if (std::chrono::steady_clock::now() >= m_wait_deadline) {
+				throw std::runtime_error("Wait timeout at " + std::to_string(m_pc));
+			}
+			// poll again after other pending handlers ran
+			continueAfter(std::chrono::microseconds(0));
+			return false;
+		}
+		m_waiting = false;
+		break;
+	}
+	case SEQ_OP_SLEEP:
+		continueAfter(std::chrono::microseconds(u32(1)));
+		m_pc = next;
+		return false;
+	case SEQ_OP_SET:
+		m_regs[u8(1)] = u16(2);
+		break;
+	case SEQ_OP_ADD:
+		m_regs[u8(1)] += u16(2);
+		break;
+	case SEQ_OP_AND:
+		m_regs[u8(1)] &= u16(2);
+		break;
+	case SEQ_OP_BRANCH: {
+		uint16_t r = m_regs[u8(1)];
+		uint16_t imm = u16(3);
+		bool taken = false;
+		switch (u8(2)) {
+		case SEQ_COND_EQ: taken = r == imm; break;
+		case SEQ_COND_NE: taken = r != imm; break;
+		case SEQ_COND_LT: taken = r < imm; break;
+		case SEQ_COND_GE: taken = r >= imm; break;
+		case SEQ_COND_ALL: taken = (r & imm) == imm; break;
+		case SEQ_COND_ANY: taken = (r & imm) != 0; break;
+		}
+		if (taken) next = u16(5);
+		break;
+	}
+	case SEQ_OP_JUMP:
+		next = u16(1);
+		break;
+	case SEQ_OP_LOOP:
+		if (--m_regs[u8(1)] != 0) next = u16(2);
+		break;
+	case SEQ_OP_EMIT:
+		if (m_results.size() >= SEQ_RESULTS_MAX_WORDS) throw std::runtime_error("Result limit exceeded");
+		m_results.push_back(m_regs[u8(1)]);
+		break;
+	case SEQ_OP_READN: {
+		size_t n = u16(3);
+		size_t offset = m_results.size();
+		if (offset + n > SEQ_RESULTS_MAX_WORDS) throw std::runtime_error("Result limit exceeded");
+		m_results.resize(offset + n);
+		m_device->readRegN(u8(1), u8(2), m_results.data() + offset, n);
+		for (size_t i = offset; i < m_results.size(); ++i) {
+			m_results[i] = be16toh(m_results[i]);
+		}
+		break;
+	}
+	}
+	m_pc = next;
+	return true;
+}
+
+void SequencerRun::finish(std::exception_ptr error) {
+	if (m_done_cb) m_done_cb(error, m_results, m_steps);
+	m_done_cb = nullptr;
+}
@@ -0,0 +1,108 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef DEVICES_SEQUENCER_H_
+#define DEVICES_SEQUENCER_H_
+
+#include <vector>
+#include <boost/asio/steady_timer.hpp>
+
+#include "Device.h"
+
+// Bytecode of register sequences. Operands are big-endian, jump targets are
+// byte offsets into the program. There are SEQ_N_REGS 16bit registers r0..r7.
+//
+//   END                                      stop and return results
+//   WRITE   addr port imm16                  write immediate value to register
+//   WRITE_R addr port r                      write r to register
+//   READ    addr port r                      read register into r
+//   WAIT    addr port mask16 value16 ms32    poll until (reg & mask) == value, fail on timeout
+//   SLEEP   us32                             pause execution
+//   SET     r imm16                          r = imm
+//   ADD     r imm16                          r = r + imm (modulo 2^16)
+//   AND     r imm16                          r = r & imm
+//   BRANCH  r cond imm16 target16            jump if cond(r, imm)
+//   JUMP    target16                         jump
+//   LOOP    r target16                       r = r - 1, jump if r != 0
+//   EMIT    r                                append r to the results
+//   READN   addr port n16                    append n words read from register to the results
+#define SEQ_OP_END 0x00
+#define SEQ_OP_WRITE 0x01
+#define SEQ_OP_WRITE_R 0x02
+#define SEQ_OP_READ 0x03
+#define SEQ_OP_WAIT 0x04
+#define SEQ_OP_SLEEP 0x05
+#define SEQ_OP_SET 0x06
+#define SEQ_OP_ADD 0x07
+#define SEQ_OP_AND 0x08
+#define SEQ_OP_BRANCH 0x09
+#define SEQ_OP_JUMP 0x0a
+#define SEQ_OP_LOOP 0x0b
+#define SEQ_OP_EMIT 0x0c
+#define SEQ_OP_READN 0x0d
+
+// conditions of BRANCH
+#define SEQ_COND_EQ 0  // r == imm
+#define SEQ_COND_NE 1  // r != imm
+#define SEQ_COND_LT 2  // r < imm
+#define SEQ_COND_GE 3  // r >= imm
+#define SEQ_COND_ALL 4  // (r & imm) == imm
+#define SEQ_COND_ANY 5  // (r & imm) != 0
+
+#define SEQ_N_REGS 8
+#define SEQ_PROGRAM_MAX_BYTES (64*1024)
+// instructions executed before yielding to other handlers of the event loop
+#define SEQ_SLICE_STEPS 256
+#define SEQ_MAX_STEPS_DEFAULT 10000000
+// upper limit of the step limit requested by clients
+#define SEQ_MAX_STEPS_LIMIT 100000000
+// words collected by EMIT and READN, keeps the reply of a run below 8 MB
+#define SEQ_RESULTS_MAX_WORDS (4*1024*1024)
+
+typedef std::shared_ptr<const std::vector<uint8_t>> ptrSequencerProgram_t;
+
+// Checks that all instructions are complete, registers and jump targets are
+// valid and the program ends with END. Throws on invalid programs.
+void validateSequencerProgram(const std::vector<uint8_t>& program);
+
+// Executes a program on a device. Sleeps and polls are scheduled on the event
+// loop, so other requests are served while a sequence is running.
+class SequencerRun : public std::enable_shared_from_this<SequencerRun> {
+public:
+	typedef std::function<void(std::exception_ptr, const std::vector<uint16_t>&, uint64_t)> fn_done_cb;
+
+	SequencerRun(const SequencerRun&) = delete;
+	SequencerRun& operator=(const SequencerRun&) = delete;
+	SequencerRun(boost::asio::io_service& io_service, ptrDevice_t device,
+			ptrSequencerProgram_t program, uint64_t max_steps, fn_done_cb cb);
+	void start();
+	// stops the run, the done callback receives an error
+	void cancel();
+
+private:
+	void run();
+	bool step();
+	void continueAfter(std::chrono::microseconds delay);
+	void finish(std::exception_ptr error);
+	uint8_t u8(size_t offset) const;
+	uint16_t u16(size_t offset) const;
+	uint32_t u32(size_t offset) const;
+
+	boost::asio::steady_timer m_timer;
+	ptrDevice_t m_device;
+	ptrSequencerProgram_t m_program;
+	uint64_t m_max_steps;
+	fn_done_cb m_done_cb;
+	size_t m_pc;
+	uint64_t m_steps;
+	uint16_t m_regs[SEQ_N_REGS];
+	std::vector<uint16_t> m_results;
+	bool m_waiting;
+	std::chrono::steady_clock::time_point m_wait_deadline;
+};
+
+#endif /* DEVICES_SEQUENCER_H_ */
@@ -0,0 +1,113 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "WriteScheduler.h"
+#include <pthread.h>
+#include <iostream>
+
+WriteScheduler::WriteScheduler(boost::asio::io_service& io_service) :
+	m_io_service(io_service),
+	m_mutex(),
+	m_cv(),
+	m_queue(),
+	m_order(0),
+	m_running(true),
+	m_thread()
+{
+	m_thread = std::thread([this]() {
+		run();
+	});
+
+	// use realtime scheduling if permitted, keep default scheduling otherwise
+	sched_param param;
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+	if (pthread_setschedparam(m_thread.native_handle(), SCHED_FIFO, &param) != 0) {
+		std::cerr << "Write scheduler running without realtime priority" << std::endl;
+	}
+}
+
+WriteScheduler::~WriteScheduler() {
+	stop();
+}
+
+void WriteScheduler::stop() {
+	// pending writes are dropped
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_cv.notify_all();
+	if (m_thread.joinable()) m_thread.join();
+}
+
+void WriteScheduler::schedule(std::vector<write_t> writes, fn_done_cb cb) {
+	auto batch = std::make_shared<batch_t>();
+	batch->writes = std::move(writes);
+	batch->results.resize(batch->writes.size());
+	batch->n_pending = batch->writes.size();
+	batch->cb = std::move(cb);
+	if (batch->n_pending == 0) {
+		m_io_service.post([batch]() {
+			batch->cb(batch->results);
+		});
+		return;
+	}
+	{
+		// writes scheduled for the same time are executed in order of submission
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < batch->writes.size(); ++i) {
+			m_queue.push(entry_t{batch->writes[i].time, m_order++, batch, i});
+		}
+	}
+	m_cv.notify_all();
+}
+
+void WriteScheduler::run() {
+	const auto spin = std::chrono::microseconds(WRITE_SCHEDULER_SPIN_US);
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_running) {
+		if (m_queue.empty()) {
+			m_cv.wait(lock);
+			continue;
+		}
+		// sleep until shortly before the next write, new writes may arrive meanwhile
+		auto time = m_queue.top().time;
+		if (clock_t::now() < time - spin) {
+			m_cv.wait_until(lock, time - spin);
+			continue;
+		}
+		entry_t entry = m_queue.top();
+		m_queue.pop();
+
+		lock.unlock();
+		while (clock_t::now() < entry.time) {}
+		execute(entry);
+		lock.lock();
+	}
+}
+
+void WriteScheduler::execute(const entry_t& entry) {
+	// runs on the scheduler thread, the batch is only touched by this thread until done
+	const write_t& write = entry.batch->writes[entry.index];
+	result_t& result = entry.batch->results[entry.index];
+	auto t_start = clock_t::now();
+	try {
+		write.device->writeReg(write.addr, write.port, write.value);
+	} catch (const std::exception& e) {
+		result.error = e.what();
+	}
+	auto t_end = clock_t::now();
+	result.lateness_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t_start - write.time).count();
+	result.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t_end - t_start).count();
+
+	if (--entry.batch->n_pending == 0) {
+		auto batch = entry.batch;
+		m_io_service.post([batch]() {
+			batch->cb(batch->results);
+		});
+	}
+}
@@ -0,0 +1,83 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef DEVICES_WRITESCHEDULER_H_
+#define DEVICES_WRITESCHEDULER_H_
+
+#include <condition_variable>
+#include <queue>
+#include <thread>
+#include <boost/asio.hpp>
+
+#include "Device.h"
+
+// time before a scheduled write at which the scheduler thread stops sleeping
+// and spins on the clock
+#define WRITE_SCHEDULER_SPIN_US 200
+
+// Executes register writes at given times of the monotonic clock on a
+// dedicated thread. Completion handlers are invoked on the thread running
+// the main io_service.
+class WriteScheduler {
+public:
+	typedef std::chrono::steady_clock clock_t;
+
+	struct write_t {
+		ptrDevice_t device;
+		uint8_t addr;
+		uint8_t port;
+		uint16_t value;
+		clock_t::time_point time;
+	};
+
+	struct result_t {
+		int64_t lateness_ns;  // time the write was issued minus scheduled time
+		int64_t duration_ns;  // duration of the USB write
+		std::string error;
+	};
+	typedef std::function<void(const std::vector<result_t>&)> fn_done_cb;
+
+	WriteScheduler(const WriteScheduler&) = delete;
+	WriteScheduler& operator=(const WriteScheduler&) = delete;
+	explicit WriteScheduler(boost::asio::io_service& io_service);
+	virtual ~WriteScheduler();
+	void stop();
+
+	// schedule a batch of writes, the handler is called once all were executed
+	void schedule(std::vector<write_t> writes, fn_done_cb cb);
+
+private:
+	struct batch_t {
+		std::vector<write_t> writes;
+		std::vector<result_t> results;
+		size_t n_pending;
+		fn_done_cb cb;
+	};
+
+	struct entry_t {
+		clock_t::time_point time;
+		uint64_t order;
+		std::shared_ptr<batch_t> batch;
+		size_t index;
+		bool operator>(const entry_t& other) const {
+			return (time != other.time) ? time > other.time : order > other.order;
+		}
+	};
+
+	void run();
+	void execute(const entry_t& entry);
+
+	boost::asio::io_service& m_io_service;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> m_queue;
+	uint64_t m_order;
+	bool m_running;
+	std::thread m_thread;
+};
+
+#endif /* DEVICES_WRITESCHEDULER_H_ */
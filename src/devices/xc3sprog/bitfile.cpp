@@ -33,6 +33,7 @@ Dmitry Teytelman [dimtey@gmail.com] 14 Jun 2006 [applied 13 Aug 2006]:
 #include <string.h>
 #include <time.h>
 #include "bitrev.h"
+#include "processing/ByteOrder.h"
 #include <stdexcept>
 
 using namespace std;
@@ -90,8 +91,6 @@ int BitFile::readBitfile(FILE *fp)
 
 int  BitFile::readBIN(FILE *fp, bool do_bitrev)
 {
-    unsigned int i;
-
     fseek(fp, 0, SEEK_END);
     length = ftell(fp); /* Fix at end */
     fseek(fp, 0, SEEK_SET);
@@ -104,11 +103,7 @@ int  BitFile::readBIN(FILE *fp, bool do_bitrev)
     if (!do_bitrev)
 	    return 0;
 
-    for(i=0; i<length; i++)
-    {
-        unsigned char data = buffer[i];
-        buffer[i] = bitRevTable[data];
-    }
+    reverseBits8(buffer, buffer, length);
     return 0;
 } 
 
@@ -304,11 +299,7 @@ int BitFile::readFile(FILE *fp, FILE_STYLE in_style)
       {
 	int res = readMCSfile(fp);
 	if (res == 0)
-	  {
-	    unsigned int i;
-	    for (i=0; i<length; i++)
-	      buffer[i] = bitRevTable[buffer[i]];
-	  }
+	  reverseBits8(buffer, buffer, length);
 	return res;
       }
     case STYLE_IHEX:
@@ -338,12 +329,9 @@ void BitFile::processData(FILE *fp)
   length=(t[0]<<24)+(t[1]<<16)+(t[2]<<8)+t[3];
   if(buffer) delete [] buffer;
   buffer=new byte[length];
-  for(unsigned int i=0; i<length&&!feof(fp); i++){
-    byte b;
-    fread(&b,1,1,fp);
-    buffer[i]=bitRevTable[b]; // Reverse the bit order.
-  }
-  if(feof(fp))  throw std::runtime_error("Unexpected end of file");
+  /* read the payload at once and reverse the bit order in place */
+  if(fread(buffer,1,length,fp) != length)  throw std::runtime_error("Unexpected end of file");
+  reverseBits8(buffer, buffer, length);
 
   fread(t,1,1,fp);
   if(!feof(fp))  error("Ignoring extra data at end of file");
@@ -354,7 +342,7 @@ void BitFile::append(uint32_t val, unsigned cnt) {
   byte  *const  nbuf = new byte[nlen];
     
   // copy old part
-  for(size_t i = 0; i < length; i++)  nbuf[i] = buffer[i];
+  if(length)  memcpy(nbuf, buffer, length);
   delete [] buffer;
   buffer = nbuf;
     
@@ -381,18 +369,14 @@ void BitFile::append(char const *fname) {
     byte  *const  nbuf = new byte[nlen];
     
     // copy old part
-    for(size_t i = 0; i < length; i++)  nbuf[i] = buffer[i];
+    if(length)  memcpy(nbuf, buffer, length);
     delete [] buffer;
     buffer = nbuf;
     
-    // append new contents
-    for(size_t i = length; i < nlen; i++) {
-      if(feof(fp))  throw std::runtime_error("Unexpected end of file");
-      
-      byte  b;
-      fread(&b, 1, 1, fp);
-      buffer[i] = bitRevTable[b]; // Reverse the bit order.
-    }
+    // append new contents and reverse the bit order
+    if(fread(buffer + length, 1, nlen - length, fp) != nlen - length)
+      throw std::runtime_error("Unexpected end of file");
+    reverseBits8(buffer + length, buffer + length, nlen - length);
     length = nlen;
 
     fclose(fp);
@@ -102,6 +102,14 @@ void IOBase::shift(bool tdi, int length, bool last)
 }
 
 
+// Send a command stream prepared by the cable for shifting TDI without reading TDO
+void IOBase::shiftStream(const unsigned char *stream, size_t n)
+{
+    if (n == 0) return;
+    flush_tms(false);
+    tx_stream(stream, n);
+}
+
 void IOBase::Usleep(unsigned int usec)
 {
   flush_tms(false);
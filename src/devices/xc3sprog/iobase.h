@@ -27,6 +27,8 @@ Dmitry Teytelman [dimtey@gmail.com] 14 Jun 2006 [applied 13 Aug 2006]:
 #ifndef IOBASE_H
 #define IOBASE_H
 
+#include <stddef.h>
+
 #define BLOCK_SIZE 65536
 #define CHUNK_SIZE 128
 #define TICK_COUNT 2048
@@ -56,12 +58,14 @@ class IOBase
   void shiftTDI(const unsigned char *tdi, int length, bool last=true);
   void shiftTDO(unsigned char *tdo, int length, bool last=true);
   void shift(bool tdi, int length, bool last=true);
+  void shiftStream(const unsigned char *stream, size_t n); // precompiled TDI-only shift
   void set_tms(bool value);
   void flush_tms(int force);
 
  protected:
   virtual void txrx_block(const unsigned char *tdi, unsigned char *tdo, int length, bool last)=0;
   virtual void tx_tms(unsigned char *pat, int length, int force)=0;
+  virtual void tx_stream(const unsigned char *stream, size_t n)=0;
   virtual void settype(int subtype) {}
 
 private:
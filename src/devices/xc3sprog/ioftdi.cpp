@@ -25,16 +25,29 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 #include <string.h>
 #include <errno.h>
 #include <stdexcept>
+#include <chrono>
 
 #include "ioftdi.h"
 
 using namespace std;
 
-IOFtdi::IOFtdi(libusb_device* dev, ftdi_interface interface, int freq)
-  : IOBase(), bptr(0), calls_rd(0), calls_wr(0), retries(0), device_has_fast_clock(true), tck_freq(30e6), buflen(0), subtype(0)
+IOFtdi::IOFtdi(libusb_context* ctx, libusb_device* dev, ftdi_interface interface, int freq,
+               unsigned int tx_chunk, unsigned int tx_depth)
+  : IOBase(), usb_ctx(ctx), bptr(0), calls_rd(0), calls_wr(0), retries(0), device_has_fast_clock(true), tck_freq(30e6), buflen(0), subtype(0)
 {
     use_ftd2xx = false;
 
+    /* txrx_block adds up to TX_BUF bytes at once */
+    this->tx_chunk = (tx_chunk < TX_BUF)? TX_BUF: tx_chunk;
+    tx_queue.resize((tx_depth < 2)? 2: tx_depth);
+    for (size_t i = 0; i < tx_queue.size(); i++)
+      {
+        tx_queue[i].buf.resize(this->tx_chunk);
+        tx_queue[i].tc = 0;
+        tx_queue[i].size = 0;
+      }
+    tx_head = 0;
+
     char *fname = getenv("FTDI_DEBUG");
     if (fname)
         fp_dbg = fopen(fname,"wb");
@@ -187,6 +200,13 @@ int IOFtdi::Init(libusb_device* dev, ftdi_interface interface, int freq)
                       ftdi_get_error_string(ftdi_handle));
               goto ftdi_fail;
          }
+          res = ftdi_write_data_set_chunksize(ftdi_handle, tx_chunk);
+          if(res < 0)
+          {
+              fprintf(stderr, "ftdi_write_data_set_chunksize: %s",
+                      ftdi_get_error_string(ftdi_handle));
+              goto ftdi_fail;
+          }
           //Set the lacentcy time to a low value
           res = ftdi_set_latency_timer(ftdi_handle, 1);
           if( res <0)
@@ -404,6 +424,32 @@ void IOFtdi::settype(int sub_type)
   subtype = sub_type;
 }
 
+/* Change TCK after Init, freq = 0 means max rate. Returns the rate set,
+   which is rounded down to what the divisor allows */
+unsigned int IOFtdi::setFrequency(unsigned int freq)
+{
+  unsigned char buf[4];
+  unsigned int base = (device_has_fast_clock)? 30000000: 6000000;
+  unsigned int divisor;
+  int n = 0;
+
+  if ((freq == 0) || (freq >= base))
+    divisor = 0;
+  else
+    divisor = base/freq - ((base%freq)?0:1);
+  if (divisor > 0xffff)
+    divisor = 0xffff;
+  if (device_has_fast_clock)
+    buf[n++] = DIS_DIV_5;
+  buf[n++] = TCK_DIVISOR;
+  buf[n++] =  divisor & 0xff;
+  buf[n++] = (divisor >> 8) & 0xff;
+  mpsse_add_cmd(buf, n);
+  mpsse_send();
+  tck_freq = base/(1+divisor);
+  return tck_freq;
+}
+
 void IOFtdi::txrx_block(const unsigned char *tdi, unsigned char *tdo,
 			int length, bool last)
 {
@@ -528,6 +574,62 @@ void IOFtdi::txrx_block(const unsigned char *tdi, unsigned char *tdo,
     }
 }
 
+/* Build the commands txrx_block sends for a TDI-only shift once, with blocks
+   of up to 64 KB instead of TX_BUF, so they can be sent without further work */
+void IOFtdi::compile_tdi(const unsigned char *tdi, int length, bool last,
+                         std::vector<unsigned char> &stream)
+{
+  unsigned int rem = (last)? length - 1: length;
+  unsigned int rembits = rem % 8;
+  unsigned int nbytes = rem / 8;
+
+  stream.clear();
+  stream.reserve(nbytes + 3*(nbytes/MPSSE_MAX_BLOCK + 1) + 6);
+  while (nbytes)
+    {
+      unsigned int n = (nbytes > MPSSE_MAX_BLOCK)? MPSSE_MAX_BLOCK: nbytes;
+      stream.push_back(MPSSE_DO_WRITE|MPSSE_LSB|MPSSE_WRITE_NEG);
+      stream.push_back((n - 1) & 0xff);
+      stream.push_back(((n - 1) >> 8) & 0xff);
+      stream.insert(stream.end(), tdi, tdi + n);
+      tdi += n;
+      nbytes -= n;
+    }
+  if (rembits)
+    {
+      stream.push_back(MPSSE_DO_WRITE|MPSSE_LSB|MPSSE_BITMODE|MPSSE_WRITE_NEG);
+      stream.push_back(rembits - 1);
+      stream.push_back(*tdi);
+    }
+  if (last)
+    {
+      bool lastbit = (*tdi & (1 << rembits));
+      stream.push_back(MPSSE_WRITE_TMS|MPSSE_LSB|MPSSE_BITMODE|MPSSE_WRITE_NEG);
+      stream.push_back(0);
+      stream.push_back((lastbit) ? 0x81 : 1);
+    }
+}
+
+void IOFtdi::tx_stream(const unsigned char *stream, size_t n)
+{
+  /* copy the stream into the write buffers, which keeps the transfer
+     queue filled across calls */
+  if(fp_dbg)
+    fprintf(fp_dbg,"tx_stream %lu\n", (unsigned long) n);
+  while (n)
+    {
+      size_t len = tx_chunk - 1 - bptr;
+      if (len > n)
+        len = n;
+      memcpy(&tx_queue[tx_head].buf[bptr], stream, len);
+      bptr += len;
+      stream += len;
+      n -= len;
+      if (bptr + 1 >= tx_chunk)
+        mpsse_send();
+    }
+}
+
 void IOFtdi::tx_tms(unsigned char *pat, int length, int force)
 {
     unsigned char buf[3] = {MPSSE_WRITE_TMS|MPSSE_LSB|MPSSE_BITMODE|
@@ -605,39 +707,36 @@ unsigned int IOFtdi::readusb(unsigned char * rbuf, unsigned long len)
     else
 #endif
     {
-
-        int length = (int) len;
-        int timeout=0, last_errno, last_read;
+        /* sleep until the data has arrived instead of polling for it */
+        int timeout_ms = RX_TIMEOUT_MS + (int)((unsigned long long)len * 8 * 1000 / tck_freq);
         calls_rd++;
-        last_read = ftdi_read_data(ftdi_handle, rbuf, length );
-        if (last_read > 0)
-            read += last_read;
-        while (((int)read <length) && ( timeout <1000)) 
+        struct ftdi_transfer_control *tc = ftdi_read_data_submit(ftdi_handle, rbuf, (int) len);
+        if (!tc)
         {
-            last_errno = 0;
-            retries++;
-            last_read = ftdi_read_data(ftdi_handle, rbuf+read, length -read);
-            if (last_read > 0)
-                read += last_read;
-            else
-                last_errno = errno;
-            timeout++;
+            fprintf(stderr,"readusb: Submitting read of %ld bytes failed\n", len);
+            throw std::runtime_error("Error submitting USB transfer");
         }
-        if (timeout >= 1000)
+        bool timed_out = !wait_transfer(tc, timeout_ms);
+        if (timed_out)
         {
-            fprintf(stderr,"readusb waiting too long for %ld bytes, only %d read\n",
-                    len, last_read);
-            if (last_errno)
-            {
-                fprintf(stderr,"error %s\n", strerror(last_errno));
-                throw std::runtime_error(strerror(last_errno));
-            }
+            /* the cancelled transfer still completes through the event handling */
+            libusb_cancel_transfer(tc->transfer);
+            wait_transfer(tc);
         }
-        if (last_read <0)
+        int offset = tc->offset;
+        int last_read = ftdi_transfer_data_done(tc);
+        if (last_read != (int) len)
         {
-            fprintf(stderr,"Error %d str: %s\n", -last_read, strerror(-last_read));
-            throw std::runtime_error(strerror(-last_read));
+            if (timed_out)
+            {
+                fprintf(stderr,"readusb waiting too long for %ld bytes, only %d read\n",
+                        len, offset);
+                throw std::runtime_error("Timeout reading from USB device");
+            }
+            fprintf(stderr,"readusb: Read of %ld bytes failed\n", len);
+            throw std::runtime_error("Error reading from USB device");
         }
+        read = last_read;
     }
   if(fp_dbg)
     {
@@ -673,6 +772,11 @@ void IOFtdi::deinit(void)
   } catch (...) {
       fprintf(stderr,"Loopback failed, expect problems on later runs\n");
   }
+  /* no transfer may reference the buffers once the device is closed */
+  try {
+      tx_drain();
+  } catch (...) {
+  }
  
 #ifdef USE_FTD2XX 
   if (ftd2xx_handle)
@@ -698,10 +802,8 @@ IOFtdi::~IOFtdi()
 }
 
 void IOFtdi::mpsse_add_cmd(unsigned char const *const buf, int const len) {
- /* The TX FIFO has 128 Byte. It can easily be overrun
-    So send only chunks of the TX Buffersize and hope
-    that the OS USB scheduler gives the MPSSE machine 
-    enough time empty the buffer
+ /* Commands are collected in the current write buffer, which is
+    submitted once full while the next one gets filled
  */
   if(fp_dbg)
     {
@@ -711,14 +813,15 @@ void IOFtdi::mpsse_add_cmd(unsigned char const *const buf, int const len) {
 	fprintf(fp_dbg," %02x",buf[i]);
       fprintf(fp_dbg,"\n");
     }
- if (bptr + len +1 >= TX_BUF)
+ if (bptr + len +1 >= tx_chunk)
    mpsse_send();
-  memcpy(usbuf + bptr, buf, len);
+  memcpy(&tx_queue[tx_head].buf[bptr], buf, len);
   bptr += len;
 }
 
 void IOFtdi::mpsse_send() {
   if(bptr == 0)  return;
+  unsigned char *usbuf = &tx_queue[tx_head].buf[0];
 
   if(fp_dbg)
     fprintf(fp_dbg,"mpsse_send %d\n", bptr);
@@ -761,21 +864,93 @@ void IOFtdi::mpsse_send() {
   else
 #endif
   {
+      /* submit without waiting, the buffer is reused once its transfer
+         has completed */
+      tx_transfer &t = tx_queue[tx_head];
       calls_wr++;
-      int written = ftdi_write_data(ftdi_handle, usbuf, bptr);
-      if(written != (int) bptr) 
+      t.tc = ftdi_write_data_submit(ftdi_handle, usbuf, bptr);
+      if (!t.tc)
       {
-          fprintf(stderr,"mpsse_send: Short write %d vs %d at run %d, Err: %s\n", 
-                  written, bptr, calls_wr, ftdi_get_error_string(ftdi_handle));
-          throw std::runtime_error(ftdi_get_error_string(ftdi_handle));
+          fprintf(stderr,"mpsse_send: Submitting %d bytes failed at run %d\n",
+                  bptr, calls_wr);
+          throw std::runtime_error("Error submitting USB transfer");
       }
+      t.size = bptr;
+      tx_head = (tx_head + 1) % tx_queue.size();
+      bptr = 0;
+      tx_wait(tx_queue[tx_head]);
   }
 
   bptr = 0;
 }
 
+/* Handle the libusb events of the device until the transfer has completed.
+   ftdi_transfer_data_done() can't be used, it handles the events of the
+   libftdi context instead of the one the device was opened in. While another
+   thread is handling events, libusb lets this one sleep until they are done */
+bool IOFtdi::wait_transfer(struct ftdi_transfer_control *tc, int timeout_ms)
+{
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (!tc->completed)
+    {
+      struct timeval tv = {1, 0};
+      if (timeout_ms >= 0)
+        {
+          long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+          if (us <= 0)
+            return false;
+          if (us < 1000000)
+            {
+              tv.tv_sec = 0;
+              tv.tv_usec = us;
+            }
+        }
+      int res = libusb_handle_events_timeout_completed(usb_ctx, &tv, &tc->completed);
+      if (res < 0 && res != LIBUSB_ERROR_INTERRUPTED)
+        {
+          fprintf(stderr,"wait_transfer: %s\n", libusb_error_name(res));
+          throw std::runtime_error(libusb_error_name(res));
+        }
+    }
+  return true;
+}
+
+void IOFtdi::tx_wait(tx_transfer &t)
+{
+  if (!t.tc)
+    return;
+  /* transfers time out after usb_write_timeout and complete with an error */
+  wait_transfer(t.tc);
+  int written = ftdi_transfer_data_done(t.tc);
+  t.tc = 0;
+  if (written != t.size)
+    {
+      fprintf(stderr,"mpsse_send: Short write %d vs %d\n", written, t.size);
+      throw std::runtime_error("Error in USB transfer");
+    }
+}
+
+/* wait for all submitted transfers, even if one of them failed */
+void IOFtdi::tx_drain()
+{
+  bool failed = false;
+  for (size_t i = 0; i < tx_queue.size(); i++)
+    {
+      try {
+        tx_wait(tx_queue[i]);
+      } catch (...) {
+        failed = true;
+      }
+    }
+  if (failed)
+    throw std::runtime_error("Error in USB transfer");
+}
+
 void IOFtdi::flush() {
   mpsse_send();
+  tx_drain();
 }
 
 /* Short delays may be prolonged by flush causing an additional frame sent
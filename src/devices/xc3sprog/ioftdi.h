@@ -37,11 +37,20 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #include "iobase.h"
 #include <stdio.h>
+#include <vector>
 
 #define VENDOR_FTDI 0x0403
 #define DEVICE_DEF  0x6010
 
 #define TX_BUF (4096)
+#define MPSSE_MAX_BLOCK (65536)
+/* Commands are sent in asynchronous transfers of TX_CHUNK_DEFAULT bytes,
+   with up to TX_QUEUE_DEFAULT transfers in flight */
+#define TX_CHUNK_DEFAULT (65536)
+#define TX_QUEUE_DEFAULT (4)
+/* readusb fails if the data hasn't arrived after RX_TIMEOUT_MS plus the
+   time to clock it */
+#define RX_TIMEOUT_MS (1000)
 
 class IOFtdi : public IOBase
 {
@@ -50,7 +59,16 @@ class IOFtdi : public IOBase
   FT_HANDLE ftd2xx_handle;   
 #endif
   struct ftdi_context *ftdi_handle;
-  unsigned char usbuf[TX_BUF];
+  libusb_context *usb_ctx;           /* context the device was opened in */
+  struct tx_transfer
+  {
+    std::vector<unsigned char> buf;
+    struct ftdi_transfer_control *tc;
+    int size;
+  };
+  std::vector<tx_transfer> tx_queue; /* ring of write buffers */
+  unsigned int tx_head;              /* buffer being filled */
+  unsigned int tx_chunk;
   int buflen;
   bool use_ftd2xx;
   unsigned int bptr;
@@ -60,11 +78,17 @@ class IOFtdi : public IOBase
   unsigned int tck_freq;
 
  public:
-  IOFtdi(libusb_device* dev, ftdi_interface interface, int freq=0);
+  IOFtdi(libusb_context* ctx, libusb_device* dev, ftdi_interface interface, int freq=0,
+         unsigned int tx_chunk=TX_CHUNK_DEFAULT, unsigned int tx_depth=TX_QUEUE_DEFAULT);
   ~IOFtdi();
   void settype(int subtype);
+  unsigned int setFrequency(unsigned int freq);
+  unsigned int getFrequency(void) { return tck_freq; }
   void txrx_block(const unsigned char *tdi, unsigned char *tdo, int length, bool last);
   void tx_tms(unsigned char *pat, int length, int force);
+  void tx_stream(const unsigned char *stream, size_t n);
+  static void compile_tdi(const unsigned char *tdi, int length, bool last,
+                          std::vector<unsigned char> &stream);
   void flush(void);
   void Usleep(unsigned int usec);
 
@@ -73,6 +97,9 @@ class IOFtdi : public IOBase
   void deinit(void);
   void mpsse_add_cmd(unsigned char const *buf, int len);
   void mpsse_send(void);
+  bool wait_transfer(struct ftdi_transfer_control *tc, int timeout_ms=-1);
+  void tx_wait(tx_transfer &t);
+  void tx_drain(void);
   unsigned int readusb(unsigned char * rbuf, unsigned long len);
 };
 
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
 
 #include "jtag.h"
 #include <unistd.h>
+#include <stdexcept>
 
 Jtag::Jtag(IOBase *iob)
 {
@@ -195,6 +196,29 @@ void Jtag::shiftDR(const byte *tdi, byte *tdo, int length,
   else shiftDRincomplete=true;
 }
 
+/* Like shiftDR without TDO, the stream must have been compiled for a chain
+   without devices after the selected one and with the last bit on exit */
+void Jtag::shiftDRStream(const std::vector<byte> &stream, int length, bool exit)
+{
+  if(deviceIndex<0)return;
+  if(deviceIndex!=0)
+    throw std::runtime_error("Precompiled shift requires the last device in the chain");
+
+  if(!shiftDRincomplete){
+    int pre=numDevices-deviceIndex-1;
+    setTapState(SHIFT_DR,pre);
+  }
+  if(fp_dbg)
+    fprintf(fp_dbg, "shiftDRStream len %d\n", length);
+  io->shiftStream(stream.data(), stream.size());
+  nextTapState(exit);
+  if(exit){
+    setTapState(postDRState);
+    shiftDRincomplete=false;
+  }
+  else shiftDRincomplete=true;
+}
+
 void Jtag::shiftIR(const byte *tdi, byte *tdo)
 {
   if(deviceIndex<0)return;
@@ -105,6 +105,7 @@ class Jtag
   void Usleep(unsigned int usec) {io->Usleep(usec);}
   int selectDevice(int dev);
   void shiftDR(const byte *tdi, byte *tdo, int length, int align=0, bool exit=true);// Some devices use TCK for aligning data, for example, Xilinx FPGAs for configuration data.
+  void shiftDRStream(const std::vector<byte> &stream, int length, bool exit=true); // TDI-only shift precompiled by the cable
   void shiftIR(const byte *tdi, byte *tdo=0); // No length argumant required as IR length specified in chainParam_t 
   inline void longToByteArray(unsigned long l, byte *b){
     b[0]=(byte)(l&0xff);
@@ -23,6 +23,7 @@ Dmitry Teytelman [dimtey@gmail.com] 14 Jun 2006 [applied 13 Aug 2006]:
 */
 
 #include "progalgxc3s.h"
+#include <algorithm>
 #include <stdexcept>
 
 
@@ -47,6 +48,7 @@ ProgAlgXC3S::ProgAlgXC3S(Jtag &j, int fam)
 {
   jtag=&j;
   family = fam;
+  slice_streams = 0;
   switch(family)
     {
     case FAMILY_XC3SE:
@@ -174,7 +176,7 @@ void ProgAlgXC3S::flow_program_legacy(BitFile &file)
   jtag->shiftIR(JSHUTDOWN);
   jtag->cycleTCK(tck_len);
   jtag->shiftIR(CFG_IN);
-  jtag->shiftDR((file.getData()),0,file.getLength());
+  flow_shift_data(file);
   jtag->cycleTCK(1);
   jtag->shiftIR(JSTART);
   jtag->cycleTCK(2*tck_len);
@@ -184,6 +186,32 @@ void ProgAlgXC3S::flow_program_legacy(BitFile &file)
   jtag->cycleTCK(1);
 }
 
+/* Shift the configuration data in slices, staying in SHIFT-DR in between,
+   so progress can be reported without changing the JTAG sequence. Slices are
+   sent as precompiled command streams if available. */
+void ProgAlgXC3S::flow_shift_data(BitFile &file)
+{
+  unsigned int length = file.getLength();
+  unsigned int n_slices = (length + PROGRESS_SLICE_BITS - 1) / PROGRESS_SLICE_BITS;
+  const slice_streams_t *streams =
+    (slice_streams && slice_streams->size() == n_slices) ? slice_streams : 0;
+  if (!progress_cb && !streams)
+    {
+      jtag->shiftDR((file.getData()),0,length);
+      return;
+    }
+  for (unsigned int i = 0, slice = 0; i < length; i += PROGRESS_SLICE_BITS, slice++)
+    {
+      unsigned int n = std::min(length - i, (unsigned int) PROGRESS_SLICE_BITS);
+      if (streams)
+        jtag->shiftDRStream((*streams)[slice],n,i + n == length);
+      else
+        jtag->shiftDR(&(file.getData())[i/8],0,n,0,i + n == length);
+      if (progress_cb)
+        progress_cb(i + n, length);
+    }
+}
+
 void ProgAlgXC3S::array_program(BitFile &file)
 {
   unsigned char buf[1] = {0};
@@ -197,9 +225,22 @@ void ProgAlgXC3S::array_program(BitFile &file)
   /* JPROGAM: Triger reconfiguration, not explained in ug332, but
      DS099 Figure 28:  Boundary-Scan Configuration Flow Diagram (p.49) */
   jtag->shiftIR(JPROGRAM);
-  do
-    jtag->shiftIR(CFG_IN, buf);
-  while (! (buf[0] & 0x10)); /* wait until configuration cleared */
+  /* wait until configuration cleared. Each poll blocks in readusb until the
+     capture arrives, the TCK cycles in between space the polls */
+  jtag->shiftIR(CFG_IN, buf);
+  while (!(buf[0] & 0x10) && (i < 1000))
+    {
+      jtag->Usleep(1000);
+      jtag->shiftIR(CFG_IN, buf);
+      i++;
+    }
+  if (!(buf[0] & 0x10)) {
+	  fprintf(stderr,
+			  "Device failed to clear configuration, INSTRUCTION_CAPTURE is 0x%02x\n",
+			  buf[0]);
+	  throw std::runtime_error("Error clearing device configuration");
+  }
+  i = 0;
 
   /* As ISC_DNA only works on a unconfigured device, see AR #29977*/
   switch(family)
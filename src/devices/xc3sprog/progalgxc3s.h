@@ -26,6 +26,8 @@ Dmitry Teytelman [dimtey@gmail.com] 14 Jun 2006 [applied 13 Aug 2006]:
 #ifndef PROGALGXC3S_H
 #define PROGALGXC3S_H
 
+#include <functional>
+#include <vector>
 #include "bitfile.h"
 #include "jtag.h"
 
@@ -48,6 +50,13 @@ Dmitry Teytelman [dimtey@gmail.com] 14 Jun 2006 [applied 13 Aug 2006]:
 #define FAMILY_XC6S     0x20
 #define FAMILY_XC5VTXT  0x22
 
+/* configuration data is shifted in slices of this many bits when progress is
+   reported or precompiled command streams are used */
+#define PROGRESS_SLICE_BITS (1024*1024)
+
+typedef std::function<void(unsigned int bits_done, unsigned int bits_total)> progress_cb_t;
+typedef std::vector<std::vector<byte> > slice_streams_t;
+
 class ProgAlgXC3S
 {
  private:
@@ -55,13 +64,19 @@ class ProgAlgXC3S
   int family;
   int tck_len;
   int array_transfer_len;
+  progress_cb_t progress_cb;
+  const slice_streams_t *slice_streams;
   void flow_enable();
   void flow_disable();
   void flow_program_xc2s(BitFile &file);
   void flow_array_program(BitFile &file);
   void flow_program_legacy(BitFile &file);
+  void flow_shift_data(BitFile &file);
  public:
   ProgAlgXC3S(Jtag &j, int family);
+  void setProgressCallback(progress_cb_t cb) { progress_cb = cb; }
+  /* command streams of the configuration data slices, see IOFtdi::compile_tdi */
+  void setSliceStreams(const slice_streams_t *streams) { slice_streams = streams; }
   void array_program(BitFile &file);
   void reconfig();
 };
@@ -13,7 +13,11 @@
 #include "network/Server.h"
 #include "config/Config.h"
 #include "devices/DeviceManager.h"
+#include "devices/AcquisitionManager.h"
 #include "DeviceRequestHandler.h"
+#include "WorkerPool.h"
+#include "cache/BlobCache.h"
+#include "cache/BitstreamCache.h"
 
 
 int main() {
@@ -32,11 +36,33 @@ int main() {
 
 		// add usb service
 		boost::asio::libusb_service libusb_service(io_service);
-		DeviceManager device_manager(io_service, libusb_service, config.device_descriptions);
-		DeviceRequestHandler rpc_handler(device_manager);
+		// parse bitfiles referenced by the configuration before the first device shows up
+		BitstreamCache bitstreams;
+		if (config.preload_bitfiles) {
+			for (auto& desc: config.device_descriptions) {
+				if (desc.fname_bitfile.empty()) continue;
+				try {
+					bitstreams.get(desc.fname_bitfile);
+				} catch (const std::exception& e) {
+					std::cerr << "Invalid bitfile " << desc.fname_bitfile << ": " << e.what() << std::endl;
+				}
+			}
+		}
+		DeviceManager device_manager(io_service, libusb_service, config.device_descriptions,
+				bitstreams, config.programming_threads, config.programmer_options);
+
+		// add worker threads for jobs outside the event loop
+		WorkerPool workers(io_service, config.worker_threads);
+
+		// add periodic acquisition jobs
+		AcquisitionManager acquisitions(io_service, device_manager, workers, config.acquisitions);
+		// add cache for repeated payload uploads
+		BlobCache blob_cache(config.blob_cache_bytes);
+		DeviceRequestHandler rpc_handler(io_service, device_manager, acquisitions, workers, blob_cache,
+				config.shm_max_bytes);
 
 		// add network service
-		Server server(config.port, io_service, rpc_handler);
+		Server server(config.port, config.local_socket, io_service, rpc_handler);
 
 		// add handlers for FaoutManager events
 		device_manager.setAddedCallback([&](const std::string& serial){
@@ -57,6 +83,13 @@ int main() {
 			RPC_EVENT_REG_CHANGED(packer_out, serial, addr, port, value);
 			server.sendAll(buffer_out);
 		});
+		device_manager.setProgrammingCallback([&](const std::string& serial, const std::string& phase,
+				size_t bytes_done, size_t bytes_total, uint64_t elapsed_ms) {
+			auto buffer_out = std::make_shared<msgpack::sbuffer>();
+			msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+			RPC_EVENT_PROGRAMMING(packer_out, serial, phase, bytes_done, bytes_total, elapsed_ms);
+			server.sendAll(buffer_out);
+		});
 
 		// add system signal handler
         boost::asio::signal_set signals(io_service);
@@ -68,7 +101,9 @@ int main() {
 			{
 				std::cout << "Shutting down" << std::endl;
 				device_manager.stop();
+				acquisitions.stop();
 				server.stop();
+				workers.stop();
 				libusb_service.stop();
 			}
 		);
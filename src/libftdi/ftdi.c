@@ -1399,6 +1399,14 @@ static void ftdi_read_data_cb(struct libusb_transfer *transfer)
     struct ftdi_context *ftdi = tc->ftdi;
     int packet_size, actual_length, num_of_chunks, chunk_remains, i, ret;
 
+    // don't resubmit a cancelled or failed transfer
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED)
+    {
+        tc->completed = 1;
+        if (tc->callback) tc->callback(tc, tc->user_data);
+        return;
+    }
+
     packet_size = ftdi->max_packet_size;
 
     actual_length = transfer->actual_length;
@@ -1486,6 +1494,14 @@ static void ftdi_write_data_cb(struct libusb_transfer *transfer)
 
     tc->offset += transfer->actual_length;
 
+    // don't resubmit after an error, ftdi_transfer_data_done() reports it
+    if (transfer->status != LIBUSB_TRANSFER_COMPLETED)
+    {
+        tc->completed = 1;
+        if (tc->callback) tc->callback(tc, tc->user_data);
+        return;
+    }
+
     if (tc->offset == tc->size)
     {
         tc->completed = 1;
@@ -200,6 +200,10 @@ int libusb_service::_hotplug_cb(libusb_context* ctx, libusb_device* device,
 	return 0;
 }
 
+libusb_context* libusb_service::context() {
+	return m_ctx;
+}
+
 void libusb_service::handleEvents() {
 	timeval tv = {0, 0};
 	libusb_handle_events_timeout_completed(m_ctx, &tv, nullptr);
@@ -34,6 +34,9 @@ public:
 
 	void addHotplugHandler(int vid, int pid, int dev_class, fn_libusb_service_hotplug cb);
 
+	// context of all devices reported by the service
+	libusb_context* context();
+
 protected:
 	// add or remove fd watcher
 	void startWatcher(int fd, short events);
@@ -8,24 +8,37 @@
 #include "ClientConnection.h"
 #include "ConnectionManager.h"
 #include <iostream>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
 
-using boost::asio::ip::tcp;
 
-
-ClientConnection::ClientConnection(boost::asio::ip::tcp::socket socket,
+ClientConnection::ClientConnection(socket_t socket,
 		ConnectionManager& manager, RequestHandler& handler) :
 		m_socket(std::move(socket)),
+		m_local(false),
 		m_connection_manager(manager),
 		m_handler(handler),
 		m_msgbuffer_in(),
 		m_msgbuffer_out(),
-		m_msgbuffer_out_offset(0)
+		m_msgbuffer_out_offset(0),
+		m_msgbuffer_out_bytes(0),
+		m_reading(false),
+		m_suspended(false),
+		m_drain_bytes(0),
+		m_drain_handler()
 {
 	// store remote address for each client?
 	//std::string remote = m_socket.remote_endpoint().address().to_string();
+	m_local = (m_socket.local_endpoint().protocol().family() == AF_UNIX);
 }
 
 ClientConnection::~ClientConnection() {
+	// close file descriptors that were never sent
+	for (auto& packet: m_msgbuffer_out) {
+		if (packet.fd >= 0) ::close(packet.fd);
+	}
 }
 
 void ClientConnection::start() {
@@ -41,10 +54,27 @@ void ClientConnection::stop() {
 			std::cerr << "Error closing socket fd=" << m_socket.native_handle();
 			std::cerr << ", " << e.what() << std::endl;
 		}
+		m_drain_handler = nullptr;
+		m_handler.clientClosed(shared_from_this());
 	}
 }
 
+bool ClientConnection::isOpen() {
+	return m_socket.is_open();
+}
+
+bool ClientConnection::isLocal() {
+	return m_local;
+}
+
 void ClientConnection::send(std::shared_ptr<msgpack::sbuffer> buffer) {
+	send(std::move(buffer), -1);
+}
+
+void ClientConnection::send(std::shared_ptr<msgpack::sbuffer> buffer, int fd) {
+	// file descriptors can only be passed over local sockets
+	if (fd >= 0 && !m_local)
+		throw std::runtime_error("Passing file descriptors requires a local socket");
 	// if there is no write in progress, schedule do_write() call
 	if (m_msgbuffer_out.empty()) {
 		auto self(shared_from_this());
@@ -52,8 +82,40 @@ void ClientConnection::send(std::shared_ptr<msgpack::sbuffer> buffer) {
 			do_write();
 		});
 	}
-	// add buffer for data to send
-	m_msgbuffer_out.emplace_back(buffer);
+	// add buffer for data to send, keep a duplicate of fd until it is sent
+	packet_t packet = {buffer, -1};
+	if (fd >= 0 && (packet.fd = ::dup(fd)) < 0)
+		throw std::runtime_error(strerror(errno));
+	m_msgbuffer_out.push_back(packet);
+	m_msgbuffer_out_bytes += buffer->size();
+}
+
+void ClientConnection::suspend() {
+	m_suspended = true;
+}
+
+void ClientConnection::resume() {
+	if (!m_suspended) return;
+	m_suspended = false;
+	// continue with buffered requests and reading from the socket
+	auto self(shared_from_this());
+	m_socket.get_io_service().post([this, self](){
+		if (m_reading || m_suspended || !m_socket.is_open()) return;
+		if (process_messages()) do_read();
+	});
+}
+
+size_t ClientConnection::pendingBytes() {
+	return m_msgbuffer_out_bytes - m_msgbuffer_out_offset;
+}
+
+void ClientConnection::asyncWaitDrain(size_t n_bytes, std::function<void()> handler) {
+	if (pendingBytes() <= n_bytes) {
+		m_socket.get_io_service().post(std::move(handler));
+	} else {
+		m_drain_bytes = n_bytes;
+		m_drain_handler = std::move(handler);
+	}
 }
 
 void ClientConnection::do_read() {
@@ -63,77 +125,146 @@ void ClientConnection::do_read() {
 	// asynchronously wait for incoming data
 	auto self(shared_from_this());
 	auto buffer = boost::asio::buffer(m_msgbuffer_in.buffer(), m_msgbuffer_in.buffer_capacity());
+	m_reading = true;
 	m_socket.async_read_some(buffer,
 		[this, self](boost::system::error_code ec, std::size_t bytes_transferred)
 		{
+			m_reading = false;
 			if (!ec) {
 				// commit received bytes
 				m_msgbuffer_in.buffer_consumed(bytes_transferred);
 
-				// forward parsed messages to handler
-				msgpack::unpacked result;
-				try {
-					while(m_msgbuffer_in.next(result)) {
-						// handle received message
-						msgpack::object object = result.get();
-						auto buffer_out = std::make_shared<msgpack::sbuffer>();
-						msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
-						m_handler.handleRequest(object, packer_out);
-						send(buffer_out);
-					}
-				} catch (msgpack::unpack_error& e) {
-					std::cerr << "MsgPack exception: " << e.what() << std::endl;
-					m_connection_manager.stop(shared_from_this());
-					return;
-				} catch (std::exception& e) {
-					std::cerr << "Request handling exception: " << e.what() << std::endl;
-					m_connection_manager.stop(shared_from_this());
-					return;
-				}
-
-				// close connection if the message size exceeds a certain limit
-				if(m_msgbuffer_in.message_size() > CONTROL_MSG_MAX_BYTES) {
-					std::cerr << "Message size exceeded, dropping client" << std::endl;
-					m_connection_manager.stop(shared_from_this());
-					return;
-				}
-
-				// continue waiting for incoming data
-				do_read();
+				// continue waiting for incoming data unless processing was suspended
+				if (process_messages()) do_read();
 	        } else if (ec != boost::asio::error::operation_aborted) {
 	        	m_connection_manager.stop(shared_from_this());
 	        }
 		});
 }
 
+bool ClientConnection::process_messages() {
+	// forward parsed messages to handler
+	msgpack::unpacked result;
+	try {
+		while(!m_suspended && m_msgbuffer_in.next(result)) {
+			// handle received message
+			msgpack::object object = result.get();
+			auto buffer_out = std::make_shared<msgpack::sbuffer>();
+			msgpack::packer<msgpack::sbuffer> packer_out(buffer_out.get());
+			m_handler.handleRequest(object, packer_out, shared_from_this());
+			if (buffer_out->size()) send(buffer_out);
+		}
+	} catch (msgpack::unpack_error& e) {
+		std::cerr << "MsgPack exception: " << e.what() << std::endl;
+		m_connection_manager.stop(shared_from_this());
+		return false;
+	} catch (std::exception& e) {
+		std::cerr << "Request handling exception: " << e.what() << std::endl;
+		m_connection_manager.stop(shared_from_this());
+		return false;
+	}
+
+	// close connection if the message size exceeds a certain limit
+	if(m_msgbuffer_in.message_size() > CONTROL_MSG_MAX_BYTES) {
+		std::cerr << "Message size exceeded, dropping client" << std::endl;
+		m_connection_manager.stop(shared_from_this());
+		return false;
+	}
+
+	return !m_suspended && m_socket.is_open();
+}
+
 void ClientConnection::do_write() {
 	if (m_msgbuffer_out.empty()) return;
 
-	auto packet = m_msgbuffer_out.front();
+	auto& packet = m_msgbuffer_out.front();
+	if (packet.fd >= 0) {
+		do_write_fd();
+		return;
+	}
 
 	auto self(shared_from_this());
-	auto buffer = boost::asio::buffer(packet->data() + m_msgbuffer_out_offset, packet->size() - m_msgbuffer_out_offset);
+	auto buffer = boost::asio::buffer(packet.buffer->data() + m_msgbuffer_out_offset,
+			packet.buffer->size() - m_msgbuffer_out_offset);
 	m_socket.async_write_some(buffer,
 		[this, self](boost::system::error_code ec, std::size_t bytes_transferred)
 		{
 			if (!ec) {
-				auto packet = m_msgbuffer_out.front();
-				m_msgbuffer_out_offset += bytes_transferred;
+				write_done(bytes_transferred);
+			} else if (ec != boost::asio::error::operation_aborted) {
+				m_connection_manager.stop(shared_from_this());
+			}
+		});
+}
 
-				if (m_msgbuffer_out_offset != packet->size()) {
-					// still bytes left to send
-					do_write();
+void ClientConnection::do_write_fd() {
+	// wait until the socket is writable, then send the first part of the
+	// packet together with the file descriptor as ancillary data
+	auto self(shared_from_this());
+	m_socket.async_write_some(boost::asio::null_buffers(),
+		[this, self](boost::system::error_code ec, std::size_t)
+		{
+			if (ec) {
+				if (ec != boost::asio::error::operation_aborted)
+					m_connection_manager.stop(shared_from_this());
+				return;
+			}
+
+			auto& packet = m_msgbuffer_out.front();
+			iovec iov;
+			iov.iov_base = packet.buffer->data();
+			iov.iov_len = packet.buffer->size();
+			char control[CMSG_SPACE(sizeof(int))];
+			memset(control, 0, sizeof(control));
+			msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+			cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+			memcpy(CMSG_DATA(cmsg), &packet.fd, sizeof(int));
+
+			ssize_t n = ::sendmsg(m_socket.native_handle(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (n < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+					do_write_fd();
 				} else {
-					// all bytes sent, remove packet
-					m_msgbuffer_out.pop_front();
-					m_msgbuffer_out_offset = 0;
-					// more packets to send?
-					if (!m_msgbuffer_out.empty()) {
-						do_write();
-					}
+					std::cerr << "Error passing file descriptor, " << strerror(errno) << std::endl;
+					m_connection_manager.stop(shared_from_this());
 				}
-			} else if (ec != boost::asio::error::operation_aborted) {
-				m_connection_manager.stop(shared_from_this());
+				return;
 			}
+			// descriptor was transferred, the remaining bytes are sent as usual
+			::close(packet.fd);
+			packet.fd = -1;
+			write_done(n);
 		});
 }
+
+void ClientConnection::write_done(std::size_t bytes_transferred) {
+	auto& packet = m_msgbuffer_out.front();
+	m_msgbuffer_out_offset += bytes_transferred;
+
+	if (m_msgbuffer_out_offset != packet.buffer->size()) {
+		// still bytes left to send
+		do_write();
+	} else {
+		// all bytes sent, remove packet
+		m_msgbuffer_out_bytes -= packet.buffer->size();
+		m_msgbuffer_out.pop_front();
+		m_msgbuffer_out_offset = 0;
+		// notify waiting handler if enough data was sent
+		if (m_drain_handler && pendingBytes() <= m_drain_bytes) {
+			m_socket.get_io_service().post(std::move(m_drain_handler));
+			m_drain_handler = nullptr;
+		}
+		// more packets to send?
+		if (!m_msgbuffer_out.empty()) {
+			do_write();
+		}
+	}
+}
@@ -11,6 +11,7 @@
 #include <memory>
 #include <array>
 #include <deque>
+#include <functional>
 #include <boost/asio.hpp>
 #include <msgpack.hpp>
 
@@ -23,27 +24,52 @@ class ConnectionManager;
 class ClientConnection
 		: public std::enable_shared_from_this<ClientConnection> {
 public:
+	typedef boost::asio::generic::stream_protocol::socket socket_t;
+
 	ClientConnection(const ClientConnection&) = delete;
 	ClientConnection& operator=(const ClientConnection&) = delete;
-	explicit ClientConnection(boost::asio::ip::tcp::socket socket,
+	explicit ClientConnection(socket_t socket,
 			ConnectionManager& manager, RequestHandler& handler);
 	virtual ~ClientConnection();
 
 	void start();
 	void stop();
+	bool isOpen();
+	bool isLocal();
 	void send(std::shared_ptr<msgpack::sbuffer> buffer);
+	void send(std::shared_ptr<msgpack::sbuffer> buffer, int fd);
+
+	// suspend processing of requests until an asynchronous reply was sent
+	void suspend();
+	void resume();
+
+	// number of bytes waiting to be sent, wait until it drops below a threshold
+	size_t pendingBytes();
+	void asyncWaitDrain(size_t n_bytes, std::function<void()> handler);
 
 private:
+	struct packet_t {
+		std::shared_ptr<msgpack::sbuffer> buffer;
+		int fd;  // file descriptor passed along with the packet, -1 if none
+	};
+
 	void do_read();
+	bool process_messages();
 	void do_write();
-	boost::asio::ip::tcp::socket m_socket;
+	void do_write_fd();
+	void write_done(std::size_t bytes_transferred);
+	socket_t m_socket;
+	bool m_local;
 	ConnectionManager& m_connection_manager;
 	RequestHandler& m_handler;
 	msgpack::unpacker m_msgbuffer_in;
-	std::deque<std::shared_ptr<msgpack::sbuffer>> m_msgbuffer_out;
+	std::deque<packet_t> m_msgbuffer_out;
 	size_t m_msgbuffer_out_offset;
+	size_t m_msgbuffer_out_bytes;
+	bool m_reading;
+	bool m_suspended;
+	size_t m_drain_bytes;
+	std::function<void()> m_drain_handler;
 };
 
-typedef std::shared_ptr<ClientConnection> ptrClientConnection_t;
-
 #endif /* CONTROLCONNECTION_H_ */
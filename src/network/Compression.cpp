@@ -0,0 +1,59 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "Compression.h"
+#include <stdexcept>
+#include <endian.h>
+#include <string.h>
+#ifdef WITH_LZ4
+#include <lz4.h>
+#endif
+
+
+bool compressionAvailable() {
+#ifdef WITH_LZ4
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool compressLZ4(const uint8_t* data, size_t n, std::vector<char>& compressed) {
+#ifdef WITH_LZ4
+	if (n > COMPRESSION_MAX_BYTES) return false;
+	compressed.resize(sizeof(uint32_t) + LZ4_compressBound(n));
+	uint32_t n_be = htobe32(n);
+	memcpy(compressed.data(), &n_be, sizeof(n_be));
+	int r = LZ4_compress_default((const char*) data, compressed.data() + sizeof(uint32_t),
+			n, compressed.size() - sizeof(uint32_t));
+	// only use compressed data if there is any benefit
+	if (r <= 0 || sizeof(uint32_t) + r >= n) return false;
+	compressed.resize(sizeof(uint32_t) + r);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void decompressLZ4(const char* compressed, size_t n, std::vector<uint8_t>& data) {
+#ifdef WITH_LZ4
+	if (n < sizeof(uint32_t))
+		throw std::runtime_error("Invalid compressed data");
+	uint32_t n_be;
+	memcpy(&n_be, compressed, sizeof(n_be));
+	size_t n_data = be32toh(n_be);
+	if (n_data > COMPRESSION_MAX_BYTES)
+		throw std::runtime_error("Compressed data too large");
+	data.resize(n_data);
+	int r = LZ4_decompress_safe(compressed + sizeof(uint32_t), (char*) data.data(),
+			n - sizeof(uint32_t), n_data);
+	if (r < 0 || size_t(r) != n_data)
+		throw std::runtime_error("Invalid compressed data");
+#else
+	throw std::runtime_error("Compression not supported");
+#endif
+}
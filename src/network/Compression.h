@@ -0,0 +1,24 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef NETWORK_COMPRESSION_H_
+#define NETWORK_COMPRESSION_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// upper limit for the size of decompressed payloads
+#define COMPRESSION_MAX_BYTES (256*1024*1024)
+
+// LZ4 compressed payloads are stored as the uncompressed size (uint32_t, be)
+// followed by a single LZ4 block
+bool compressionAvailable();
+bool compressLZ4(const uint8_t* data, size_t n, std::vector<char>& compressed);
+void decompressLZ4(const char* compressed, size_t n, std::vector<uint8_t>& data);
+
+#endif /* NETWORK_COMPRESSION_H_ */
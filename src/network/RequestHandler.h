@@ -8,8 +8,12 @@
 #ifndef CONTROLHANDLER_H_
 #define CONTROLHANDLER_H_
 
+#include <memory>
 #include <msgpack.hpp>
 
+class ClientConnection;
+typedef std::shared_ptr<ClientConnection> ptrClientConnection_t;
+
 class RequestHandler {
 public:
 	RequestHandler(const RequestHandler&) = delete;
@@ -17,7 +21,10 @@ public:
 	explicit RequestHandler() {};
 	virtual ~RequestHandler() {};
 
-	virtual void handleRequest(msgpack::object& request, msgpack::packer<msgpack::sbuffer>& reply) = 0;
+	// handle request from a client, an empty reply is not sent back to the client
+	virtual void handleRequest(msgpack::object& request, msgpack::packer<msgpack::sbuffer>& reply,
+			ptrClientConnection_t client) = 0;
+	virtual void clientClosed(ptrClientConnection_t client) {};
 };
 
 #endif /* CONTROLHANDLER_H_ */
@@ -7,47 +7,89 @@
 
 #include "Server.h"
 #include <iostream>
+#include <unistd.h>
+#include <sys/stat.h>
 
 using boost::asio::ip::tcp;
+using boost::asio::local::stream_protocol;
 
 
-Server::Server(int port, boost::asio::io_service& service, RequestHandler& handler) :
+Server::Server(int port, const std::string& local_path,
+		boost::asio::io_service& service, RequestHandler& handler) :
 		m_handler(handler),
-		m_acceptor(service),
-		m_socket(service),
+		m_service(service),
+		m_acceptors(),
+		m_local_path(local_path),
 		m_connection_manager()
 {
-	tcp::endpoint ep4(tcp::v4(), port);
-	m_acceptor.open(ep4.protocol());
-	m_acceptor.set_option(tcp::acceptor::reuse_address(true));
-	m_acceptor.bind(ep4);
-	m_acceptor.listen();
-	std::cout << "Listening on: " <<
-			ep4.address().to_string() << ":" << ep4.port() << std::endl;
-	do_accept();
+	if (port <= 0 && local_path.empty())
+		throw std::runtime_error("Neither tcp port nor local socket configured");
+
+	// tcp listener, disabled for port <= 0
+	if (port > 0) {
+		tcp::endpoint ep4(tcp::v4(), port);
+		listen(ep4, true);
+		std::cout << "Listening on: " <<
+				ep4.address().to_string() << ":" << ep4.port() << std::endl;
+	}
+
+	// unix domain socket listener for clients on the same host
+	if (!local_path.empty()) {
+		// remove stale socket file from previous runs, but never anything else
+		struct stat st;
+		if (::lstat(local_path.c_str(), &st) == 0 && !S_ISSOCK(st.st_mode))
+			throw std::runtime_error("Local socket path exists and is not a socket: " + local_path);
+		unlink_socket();
+		stream_protocol::endpoint ep_local(local_path);
+		listen(ep_local, false);
+		// read/write for owner and group, independent of the umask
+		::chmod(local_path.c_str(), SERVER_LOCAL_SOCKET_MODE);
+		std::cout << "Listening on: " << local_path << std::endl;
+	}
 }
 
 Server::~Server() {
 }
 
+void Server::listen(const acceptor_t::endpoint_type& endpoint, bool reuse_address) {
+	m_acceptors.emplace_back(m_service);
+	acceptor_t& acceptor = m_acceptors.back();
+	acceptor.open(endpoint.protocol());
+	if (reuse_address)
+		acceptor.set_option(acceptor_t::reuse_address(true));
+	acceptor.bind(endpoint);
+	acceptor.listen();
+	do_accept(acceptor);
+}
+
 void Server::stop() {
-	m_acceptor.close();
+	for (auto& acceptor: m_acceptors) {
+		acceptor.close();
+	}
+	unlink_socket();
 	m_connection_manager.stopAll();
 }
 
-void Server::do_accept() {
-	m_acceptor.async_accept(m_socket,
-		[this](boost::system::error_code ec) {
+void Server::unlink_socket() {
+	struct stat st;
+	if (!m_local_path.empty() && ::lstat(m_local_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+		::unlink(m_local_path.c_str());
+}
+
+void Server::do_accept(acceptor_t& acceptor) {
+	auto socket = std::make_shared<ClientConnection::socket_t>(m_service);
+	acceptor.async_accept(*socket,
+		[this, &acceptor, socket](boost::system::error_code ec) {
 			// check whether the server was stopped
-			if (!m_acceptor.is_open()) return;
+			if (!acceptor.is_open()) return;
 
 			if (!ec) {
 				m_connection_manager.start(
 					std::make_shared<ClientConnection>(
-						std::move(m_socket), m_connection_manager, m_handler)
+						std::move(*socket), m_connection_manager, m_handler)
 				);
 			}
-			do_accept();
+			do_accept(acceptor);
 		});
 }
 
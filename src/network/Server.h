@@ -10,16 +10,23 @@
 
 #include <boost/asio.hpp>
 #include <string>
+#include <list>
 
 #include "ClientConnection.h"
 #include "ConnectionManager.h"
 #include "RequestHandler.h"
 
+// permissions of the local socket, clients need write access to connect
+#define SERVER_LOCAL_SOCKET_MODE 0660
+
 class Server {
 public:
+	typedef boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> acceptor_t;
+
 	Server(const Server&) = delete;
 	Server& operator=(const Server&) = delete;
-	explicit Server(int port, boost::asio::io_service& service, RequestHandler& handler);
+	explicit Server(int port, const std::string& local_path,
+			boost::asio::io_service& service, RequestHandler& handler);
 	virtual ~Server();
 
 	void sendAll(std::shared_ptr<msgpack::sbuffer>& buffer);
@@ -27,10 +34,13 @@ public:
 
 private:
 	RequestHandler& m_handler;
-	boost::asio::ip::tcp::acceptor m_acceptor;
-	boost::asio::ip::tcp::socket m_socket;
+	boost::asio::io_service& m_service;
+	std::list<acceptor_t> m_acceptors;
+	std::string m_local_path;
 	ConnectionManager m_connection_manager;
-	void do_accept();
+	void listen(const acceptor_t::endpoint_type& endpoint, bool reuse_address);
+	void do_accept(acceptor_t& acceptor);
+	void unlink_socket();
 };
 
 #endif /* CONTROLSERVER_H_ */
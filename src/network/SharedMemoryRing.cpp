@@ -0,0 +1,93 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "SharedMemoryRing.h"
+#include <stdexcept>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+
+SharedMemoryRing::SharedMemoryRing(size_t size) :
+		m_fd(-1),
+		m_data(nullptr),
+		m_size(size),
+		m_head(0),
+		m_allocated()
+{
+	if (size == 0 || size > SHM_RING_MAX_BYTES)
+		throw std::runtime_error("Invalid shared memory size");
+
+	// create anonymous memory file, sealed against resizing by the client
+	m_fd = memfd_create("fpga-device-server", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (m_fd < 0)
+		throw std::runtime_error(strerror(errno));
+	if (ftruncate(m_fd, m_size) != 0 ||
+			fcntl(m_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+		int err = errno;
+		::close(m_fd);
+		throw std::runtime_error(strerror(err));
+	}
+
+	void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) {
+		int err = errno;
+		::close(m_fd);
+		throw std::runtime_error(strerror(err));
+	}
+	m_data = static_cast<uint8_t*>(data);
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+	munmap(m_data, m_size);
+	::close(m_fd);
+}
+
+int SharedMemoryRing::fd() const {
+	return m_fd;
+}
+
+size_t SharedMemoryRing::size() const {
+	return m_size;
+}
+
+bool SharedMemoryRing::isFree(size_t offset, size_t n) {
+	if (offset + n > m_size) return false;
+	// check for overlap with the allocations next to offset
+	auto it = m_allocated.lower_bound(offset);
+	if (it != m_allocated.end() && it->first < offset + n) return false;
+	if (it != m_allocated.begin() && (--it)->first + it->second > offset) return false;
+	return true;
+}
+
+uint8_t* SharedMemoryRing::allocate(size_t n, size_t& offset) {
+	if (n == 0 || n > m_size) return nullptr;
+	size_t n_aligned = (n + SHM_RING_ALIGN - 1) & ~size_t(SHM_RING_ALIGN - 1);
+	if (m_allocated.empty()) m_head = 0;
+
+	// continue at head position or wrap around to the start of the ring
+	if (isFree(m_head, n)) {
+		offset = m_head;
+	} else if (isFree(0, n)) {
+		offset = 0;
+	} else {
+		return nullptr;
+	}
+	m_allocated.insert(std::make_pair(offset, n));
+	m_head = std::min(offset + n_aligned, m_size);
+	return m_data + offset;
+}
+
+void SharedMemoryRing::release(size_t offset) {
+	m_allocated.erase(offset);
+}
+
+bool SharedMemoryRing::inUse() const {
+	return !m_allocated.empty();
+}
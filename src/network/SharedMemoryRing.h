@@ -0,0 +1,49 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef NETWORK_SHAREDMEMORYRING_H_
+#define NETWORK_SHAREDMEMORYRING_H_
+
+#include <map>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#define SHM_RING_MAX_BYTES (1024*1024*1024)
+// default limit of the rings of all clients together
+#define SHM_TOTAL_DEFAULT_BYTES (1024*1024*1024)
+#define SHM_RING_ALIGN 64
+
+// Memory region shared with a local client via memfd. Bulk data is written to
+// regions allocated from the ring and stays valid until released by the client.
+class SharedMemoryRing {
+public:
+	SharedMemoryRing(const SharedMemoryRing&) = delete;
+	SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+	explicit SharedMemoryRing(size_t size);
+	virtual ~SharedMemoryRing();
+
+	int fd() const;
+	size_t size() const;
+
+	uint8_t* allocate(size_t n, size_t& offset);
+	void release(size_t offset);
+	// true while any region is allocated
+	bool inUse() const;
+
+private:
+	bool isFree(size_t offset, size_t n);
+	int m_fd;
+	uint8_t* m_data;
+	size_t m_size;
+	size_t m_head;
+	std::map<size_t, size_t> m_allocated;
+};
+
+typedef std::shared_ptr<SharedMemoryRing> ptrSharedMemoryRing_t;
+
+#endif /* NETWORK_SHAREDMEMORYRING_H_ */
@@ -0,0 +1,131 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "Analysis.h"
+#include <algorithm>
+#include <stdexcept>
+#include <endian.h>
+#include "Simd.h"
+
+// number of values converted per block before updating the histogram
+#define HISTOGRAM_BLOCK_WORDS 256
+
+void histogram(const uint16_t* data_be, size_t n, uint16_t lo, uint16_t bin_width,
+		size_t n_bins, histogram_t& result)
+{
+	if (bin_width == 0 || n_bins == 0 || n_bins > 0x10000) throw std::invalid_argument("Invalid histogram bins");
+	result.counts.assign(n_bins, 0);
+	result.underflow = 0;
+	result.overflow = 0;
+
+	// x / bin_width == (x * m) >> 32 for all 16bit x with m = ceil(2^32 / bin_width),
+	// values below lo get an offset that maps beyond the last bin
+	uint64_t m = ((uint64_t(1) << 32) + bin_width - 1) / bin_width;
+
+	// four interleaved partial histograms avoid stalls on runs of equal values
+	std::vector<uint32_t> partial(4 * n_bins, 0);
+	uint32_t offset[HISTOGRAM_BLOCK_WORDS];
+	uint64_t underflow = 0;
+
+	for (size_t i = 0; i < n; i += HISTOGRAM_BLOCK_WORDS) {
+		size_t n_block = std::min(n - i, size_t(HISTOGRAM_BLOCK_WORDS));
+		size_t j = 0;
+#ifdef __SSE2__
+		// swap to host order and subtract lo, the upper half is set for values below lo
+		const __m128i v_lo = _mm_set1_epi16((short) lo);
+		for (; j + 8 <= n_block; j += 8) {
+			__m128i x = bswap16_epi16(_mm_loadu_si128((const __m128i*) (data_be + i + j)));
+			__m128i below = _mm_xor_si128(cmpge_epu16(x, v_lo), _mm_set1_epi16(-1));
+			__m128i diff = _mm_subs_epu16(x, v_lo);
+			underflow += __builtin_popcount(_mm_movemask_epi8(below)) / 2;
+			_mm_storeu_si128((__m128i*) (offset + j), _mm_unpacklo_epi16(diff, below));
+			_mm_storeu_si128((__m128i*) (offset + j + 4), _mm_unpackhi_epi16(diff, below));
+		}
+#endif
+		for (; j < n_block; ++j) {
+			uint16_t v = be16toh(data_be[i + j]);
+			if (v < lo) {
+				underflow++;
+				offset[j] = 0xffffffff;
+			} else {
+				offset[j] = v - lo;
+			}
+		}
+
+		for (j = 0; j < n_block; ++j) {
+			uint64_t bin = (offset[j] * m) >> 32;
+			if (bin < n_bins) {
+				partial[(j & 3) * n_bins + bin]++;
+			}
+		}
+	}
+
+	uint64_t in_range = 0;
+	for (size_t b = 0; b < n_bins; ++b) {
+		result.counts[b] = partial[b] + partial[n_bins + b] + partial[2*n_bins + b] + partial[3*n_bins + b];
+		in_range += result.counts[b];
+	}
+	result.underflow = underflow;
+	result.overflow = n - underflow - in_range;
+}
+
+static inline void addEvent(size_t index, uint16_t value, size_t max_events, size_t& n_events,
+		std::vector<uint32_t>& indices, std::vector<uint16_t>& values)
+{
+	if (n_events++ < max_events) {
+		indices.push_back(index);
+		values.push_back(value);
+	}
+}
+
+size_t thresholdEvents(const uint16_t* data_be, size_t n, uint16_t threshold,
+		event_edge_t edge, bool initial_above, size_t max_events,
+		std::vector<uint32_t>& indices, std::vector<uint16_t>& values)
+{
+	indices.clear();
+	values.clear();
+	size_t n_events = 0;
+	bool above = initial_above;
+	size_t i = 0;
+#ifdef __SSE2__
+	// compare eight words at once and only visit blocks that contain a crossing
+	const __m128i v_threshold = _mm_set1_epi16((short) threshold);
+	for (; i + 8 <= n; i += 8) {
+		__m128i x = bswap16_epi16(_mm_loadu_si128((const __m128i*) (data_be + i)));
+		// one bit per word, taken from the low byte of each lane
+		unsigned mask = _mm_movemask_epi8(cmpge_epu16(x, v_threshold)) & 0x5555;
+		unsigned prev = ((mask << 2) | (above ? 1 : 0)) & 0x5555;
+		unsigned changed = mask ^ prev;
+		if (edge == EVENT_EDGE_RISING) changed &= mask;
+		else if (edge == EVENT_EDGE_FALLING) changed &= ~mask;
+		while (changed) {
+			unsigned bit = __builtin_ctz(changed);
+			size_t k = i + bit / 2;
+			addEvent(k, be16toh(data_be[k]), max_events, n_events, indices, values);
+			changed &= changed - 1;
+		}
+		above = mask & 0x4000;
+	}
+#endif
+	for (; i < n; ++i) {
+		uint16_t v = be16toh(data_be[i]);
+		bool now_above = v >= threshold;
+		if (now_above != above && (edge & (now_above ? EVENT_EDGE_RISING : EVENT_EDGE_FALLING))) {
+			addEvent(i, v, max_events, n_events, indices, values);
+		}
+		above = now_above;
+	}
+	return n_events;
+}
+
+bool parseEventEdge(const std::string& str, event_edge_t& edge) {
+	if (str == "rising") edge = EVENT_EDGE_RISING;
+	else if (str == "falling") edge = EVENT_EDGE_FALLING;
+	else if (str == "both") edge = EVENT_EDGE_BOTH;
+	else return false;
+	return true;
+}
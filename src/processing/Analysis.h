@@ -0,0 +1,46 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef PROCESSING_ANALYSIS_H_
+#define PROCESSING_ANALYSIS_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Amplitude histogram of big-endian uint16_t data. Bin i counts values in
+// [lo + i*bin_width, lo + (i+1)*bin_width), values outside of all bins are
+// counted as underflow or overflow.
+struct histogram_t {
+	std::vector<uint32_t> counts;
+	uint64_t underflow = 0;
+	uint64_t overflow = 0;
+};
+
+void histogram(const uint16_t* data_be, size_t n, uint16_t lo, uint16_t bin_width,
+		size_t n_bins, histogram_t& result);
+
+// Threshold crossings of big-endian uint16_t data. A rising event is the first
+// index with a value >= threshold after a value below, a falling event the
+// first index below threshold after a value >= threshold. The first word only
+// counts as crossing if it differs from `initial_above`. At most max_events
+// events are returned, the function returns the total number of crossings.
+enum event_edge_t {
+	EVENT_EDGE_RISING = 1,
+	EVENT_EDGE_FALLING = 2,
+	EVENT_EDGE_BOTH = 3
+};
+
+// parses "rising", "falling" or "both", returns false for other strings
+bool parseEventEdge(const std::string& str, event_edge_t& edge);
+
+size_t thresholdEvents(const uint16_t* data_be, size_t n, uint16_t threshold,
+		event_edge_t edge, bool initial_above, size_t max_events,
+		std::vector<uint32_t>& indices, std::vector<uint16_t>& values);
+
+#endif /* PROCESSING_ANALYSIS_H_ */
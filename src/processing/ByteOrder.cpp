@@ -0,0 +1,117 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "ByteOrder.h"
+#include "Simd.h"
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+void swapBytes16(const uint16_t* src, uint16_t* dst, size_t n) {
+	size_t i = 0;
+#ifdef __AVX2__
+	const __m256i shuffle256 = _mm256_setr_epi8(
+			1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+			1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	for (; i + 16 <= n; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i*) (src + i));
+		_mm256_storeu_si256((__m256i*) (dst + i), _mm256_shuffle_epi8(x, shuffle256));
+	}
+#endif
+#if defined(__SSSE3__)
+	const __m128i shuffle = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	for (; i + 8 <= n; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_shuffle_epi8(x, shuffle));
+	}
+#elif defined(__SSE2__)
+	for (; i + 8 <= n; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		_mm_storeu_si128((__m128i*) (dst + i), bswap16_epi16(x));
+	}
+#endif
+	for (; i < n; ++i) {
+		dst[i] = __builtin_bswap16(src[i]);
+	}
+}
+
+void swapBytes32(const uint32_t* src, uint32_t* dst, size_t n) {
+	size_t i = 0;
+#ifdef __AVX2__
+	const __m256i shuffle256 = _mm256_setr_epi8(
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for (; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i*) (src + i));
+		_mm256_storeu_si256((__m256i*) (dst + i), _mm256_shuffle_epi8(x, shuffle256));
+	}
+#endif
+#if defined(__SSSE3__)
+	const __m128i shuffle = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for (; i + 4 <= n; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_shuffle_epi8(x, shuffle));
+	}
+#elif defined(__SSE2__)
+	for (; i + 4 <= n; i += 4) {
+		// swap words, then bytes within words
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1);
+		_mm_storeu_si128((__m128i*) (dst + i), bswap16_epi16(x));
+	}
+#endif
+	for (; i < n; ++i) {
+		dst[i] = __builtin_bswap32(src[i]);
+	}
+}
+
+void reverseBits8(const uint8_t* src, uint8_t* dst, size_t n) {
+	// bit-reversed values of all nibbles
+	static const uint8_t nibble_rev[16] = {
+			0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+			0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf};
+	size_t i = 0;
+#ifdef __AVX2__
+	// reverse both nibbles by table lookup and swap them
+	const __m256i lut256 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) nibble_rev));
+	const __m256i mask256 = _mm256_set1_epi8(0x0f);
+	for (; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*) (src + i));
+		__m256i lo = _mm256_shuffle_epi8(lut256, _mm256_and_si256(x, mask256));
+		__m256i hi = _mm256_shuffle_epi8(lut256, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask256));
+		_mm256_storeu_si256((__m256i*) (dst + i), _mm256_or_si256(_mm256_slli_epi16(lo, 4), hi));
+	}
+#endif
+#if defined(__SSSE3__)
+	const __m128i lut = _mm_loadu_si128((const __m128i*) nibble_rev);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		__m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(x, mask));
+		__m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_or_si128(_mm_slli_epi16(lo, 4), hi));
+	}
+#elif defined(__SSE2__)
+	// swap nibbles, bit pairs and single bits with masked shifts
+	const __m128i m4 = _mm_set1_epi8(0x0f);
+	const __m128i m2 = _mm_set1_epi8(0x33);
+	const __m128i m1 = _mm_set1_epi8(0x55);
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (src + i));
+		x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 4), m4), _mm_slli_epi16(_mm_and_si128(x, m4), 4));
+		x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 2), m2), _mm_slli_epi16(_mm_and_si128(x, m2), 2));
+		x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 1), m1), _mm_slli_epi16(_mm_and_si128(x, m1), 1));
+		_mm_storeu_si128((__m128i*) (dst + i), x);
+	}
+#endif
+	for (; i < n; ++i) {
+		dst[i] = (nibble_rev[src[i] & 0x0f] << 4) | nibble_rev[src[i] >> 4];
+	}
+}
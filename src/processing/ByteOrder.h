@@ -0,0 +1,23 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef PROCESSING_BYTEORDER_H_
+#define PROCESSING_BYTEORDER_H_
+
+#include <cstdint>
+#include <cstddef>
+
+// Swap the bytes of n 16bit words from src to dst, src and dst may be equal.
+void swapBytes16(const uint16_t* src, uint16_t* dst, size_t n);
+
+// Swap the bytes of n 32bit words from src to dst, src and dst may be equal.
+void swapBytes32(const uint32_t* src, uint32_t* dst, size_t n);
+
+// Reverse the bit order within each of n bytes from src to dst, src and dst may be equal.
+void reverseBits8(const uint8_t* src, uint8_t* dst, size_t n);
+
+#endif /* PROCESSING_BYTEORDER_H_ */
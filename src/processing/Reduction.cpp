@@ -0,0 +1,103 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#include "Reduction.h"
+#include <algorithm>
+#include <endian.h>
+#include "Simd.h"
+
+#ifdef __SSE2__
+static inline void store_minmax(__m128i vmin, __m128i vmax, uint16_t& min, uint16_t& max) {
+	uint16_t a_min[8], a_max[8];
+	_mm_storeu_si128((__m128i*) a_min, vmin);
+	_mm_storeu_si128((__m128i*) a_max, vmax);
+	for (int i = 0; i < 8; ++i) {
+		min = std::min(min, a_min[i]);
+		max = std::max(max, a_max[i]);
+	}
+}
+#endif
+
+size_t reducedLength(size_t n, size_t factor) {
+	if (factor == 0) return 0;
+	return (n + factor - 1) / factor;
+}
+
+static void minMaxBin(const uint16_t* data_be, size_t n, uint16_t& min, uint16_t& max) {
+	min = 0xffff;
+	max = 0;
+	size_t i = 0;
+#ifdef __SSE2__
+	if (n >= 8) {
+		__m128i vmin = _mm_set1_epi16((short) 0xffff);
+		__m128i vmax = _mm_setzero_si128();
+		for (; i + 8 <= n; i += 8) {
+			__m128i x = bswap16_epi16(_mm_loadu_si128((const __m128i*) (data_be + i)));
+			vmin = min_epu16(vmin, x);
+			vmax = max_epu16(vmax, x);
+		}
+		store_minmax(vmin, vmax, min, max);
+	}
+#endif
+	for (; i < n; ++i) {
+		uint16_t v = be16toh(data_be[i]);
+		min = std::min(min, v);
+		max = std::max(max, v);
+	}
+}
+
+static uint64_t sumBin(const uint16_t* data_be, size_t n) {
+	uint64_t sum = 0;
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	while (i + 8 <= n) {
+		// each 32bit lane adds two words per iteration, 2^15 * 2 * 0xffff still fits
+		size_t n_block = std::min(n - i, size_t(8) << 15) & ~size_t(7);
+		__m128i acc = _mm_setzero_si128();
+		for (size_t end = i + n_block; i < end; i += 8) {
+			__m128i x = bswap16_epi16(_mm_loadu_si128((const __m128i*) (data_be + i)));
+			acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(x, zero), _mm_unpackhi_epi16(x, zero)));
+		}
+		uint32_t a_acc[4];
+		_mm_storeu_si128((__m128i*) a_acc, acc);
+		sum += uint64_t(a_acc[0]) + a_acc[1] + a_acc[2] + a_acc[3];
+	}
+#endif
+	for (; i < n; ++i) {
+		sum += be16toh(data_be[i]);
+	}
+	return sum;
+}
+
+void reduceMinMax(const uint16_t* data_be, size_t n, size_t factor, uint16_t* min_be, uint16_t* max_be) {
+	size_t n_out = reducedLength(n, factor);
+	for (size_t k = 0; k < n_out; ++k) {
+		size_t offset = k * factor;
+		uint16_t min, max;
+		minMaxBin(data_be + offset, std::min(factor, n - offset), min, max);
+		min_be[k] = htobe16(min);
+		max_be[k] = htobe16(max);
+	}
+}
+
+void reduceMean(const uint16_t* data_be, size_t n, size_t factor, uint16_t* mean_be) {
+	size_t n_out = reducedLength(n, factor);
+	for (size_t k = 0; k < n_out; ++k) {
+		size_t offset = k * factor;
+		size_t n_bin = std::min(factor, n - offset);
+		uint64_t sum = sumBin(data_be + offset, n_bin);
+		mean_be[k] = htobe16((sum + n_bin / 2) / n_bin);
+	}
+}
+
+void reduceDecimate(const uint16_t* data_be, size_t n, size_t factor, uint16_t* out_be) {
+	size_t n_out = reducedLength(n, factor);
+	for (size_t k = 0; k < n_out; ++k) {
+		out_be[k] = data_be[k * factor];
+	}
+}
@@ -0,0 +1,21 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef PROCESSING_REDUCTION_H_
+#define PROCESSING_REDUCTION_H_
+
+#include <cstdint>
+#include <cstddef>
+
+// Reduction of big-endian uint16_t data in bins of `factor` words. All
+// functions write ceil(n / factor) big-endian results per output array.
+size_t reducedLength(size_t n, size_t factor);
+void reduceMinMax(const uint16_t* data_be, size_t n, size_t factor, uint16_t* min_be, uint16_t* max_be);
+void reduceMean(const uint16_t* data_be, size_t n, size_t factor, uint16_t* mean_be);
+void reduceDecimate(const uint16_t* data_be, size_t n, size_t factor, uint16_t* out_be);
+
+#endif /* PROCESSING_REDUCTION_H_ */
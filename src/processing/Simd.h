@@ -0,0 +1,46 @@
+//-----------------------------------------------------------------------------
+// Author: Peter Würtz, TU Kaiserslautern (2016)
+//
+// Distributed under the terms of the GNU General Public License Version 3.
+// The full license is in the file COPYING.txt, distributed with this software.
+//-----------------------------------------------------------------------------
+
+#ifndef PROCESSING_SIMD_H_
+#define PROCESSING_SIMD_H_
+
+// SSE helpers shared by the processing kernels. Only included by translation
+// units that provide a scalar fallback for targets without SSE2.
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+// swap bytes of eight 16bit words
+static inline __m128i bswap16_epi16(__m128i x) {
+	return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+// unsigned 16bit min/max, emulated with signed compares if SSE4.1 is not available
+#ifdef __SSE4_1__
+static inline __m128i min_epu16(__m128i a, __m128i b) { return _mm_min_epu16(a, b); }
+static inline __m128i max_epu16(__m128i a, __m128i b) { return _mm_max_epu16(a, b); }
+#else
+static inline __m128i min_epu16(__m128i a, __m128i b) {
+	const __m128i sign = _mm_set1_epi16((short) 0x8000);
+	return _mm_xor_si128(_mm_min_epi16(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign)), sign);
+}
+static inline __m128i max_epu16(__m128i a, __m128i b) {
+	const __m128i sign = _mm_set1_epi16((short) 0x8000);
+	return _mm_xor_si128(_mm_max_epi16(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign)), sign);
+}
+#endif
+
+// unsigned 16bit a >= b, all bits of a lane set if true
+static inline __m128i cmpge_epu16(__m128i a, __m128i b) {
+	return _mm_cmpeq_epi16(max_epu16(a, b), a);
+}
+#endif
+
+#endif /* PROCESSING_SIMD_H_ */